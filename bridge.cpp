@@ -28,7 +28,7 @@ BridgeScreen::~BridgeScreen() {
 
 void BridgeScreen::start() {
 	_vm->clearObjects();
-	_vm->data._currentScreen.polygons.clear();
+	_vm->data.clearScreenPolys();
 	_vm->data._currentScreen.world = 0x5f;
 	_vm->data._currentScreen.screen = 0xff;
 
@@ -88,7 +88,7 @@ void BridgeScreen::toggleViewscreen() {
 	_viewscreenMode = !_viewscreenMode;
 
 	// force palette reset
-	_vm->_gfx->setBackgroundImage("bridge.rm");
+	_vm->_gfx->restoreBackgroundPalette();
 
 	for (unsigned int i = 0; i < 6; i++) {
 		if (_bridgeObjects[i])
@@ -241,8 +241,7 @@ void BridgeScreen::draw() {
 
 	// sensor.mrg has buttons
 	// 4 sprites: "bridge" in/out and "viewscreen" in/out
-	MRGFile mrg;
-	_vm->_gfx->loadMRG("sensor.mrg", &mrg);
+	MRGFile &mrg = _vm->_gfx->getMRG("sensor.mrg");
 	uint buttonId = 3;
 	if (_viewscreenMode)
 		buttonId = 1;
@@ -256,8 +255,7 @@ void BridgeScreen::draw() {
 	// 20: some grey thing
 
 	// draw grayed up/down arrows
-	MRGFile tmrg;
-	_vm->_gfx->loadMRG("transp.mrg", &tmrg);
+	MRGFile &tmrg = _vm->_gfx->getMRG("transp.mrg");
 	_vm->_gfx->drawMRG(&tmrg, 2, 117, 426);
 	_vm->_gfx->drawMRG(&tmrg, 5, 117, 450);
 
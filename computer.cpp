@@ -41,7 +41,7 @@ enum {
 
 void ComputerScreen::start() {
 	_vm->clearObjects();
-	_vm->data._currentScreen.polygons.clear();
+	_vm->data.clearScreenPolys();
 	_vm->data._currentScreen.world = 0x5f;
 	_vm->data._currentScreen.screen = 0xff;
 
@@ -163,8 +163,7 @@ void ComputerScreen::mouseClick(const Common::Point &pos) {
 }
 
 void ComputerScreen::draw() {
-	MRGFile mrg;
-	_vm->_gfx->loadMRG("compute1.pic", &mrg);
+	MRGFile &mrg = _vm->_gfx->getMRG("compute1.pic");
 
 	// draw title list
 	for (uint i = 0; i < 15; i++) {
@@ -22,13 +22,94 @@
 
 #include "unity/console.h"
 #include "unity/unity.h"
+#include "unity/graphics.h"
+#include "unity/sound.h"
 
 namespace Unity {
 
 UnityConsole::UnityConsole(UnityEngine *vm) :  _vm(vm) {
+	registerCmd("palette", WRAP_METHOD(UnityConsole, cmdPalette));
+	registerCmd("polygons", WRAP_METHOD(UnityConsole, cmdPolygons));
+	registerCmd("composite", WRAP_METHOD(UnityConsole, cmdComposite));
+	registerCmd("benchmark", WRAP_METHOD(UnityConsole, cmdBenchmark));
+	registerCmd("decoders", WRAP_METHOD(UnityConsole, cmdDecoders));
+	registerCmd("sfx", WRAP_METHOD(UnityConsole, cmdSfx));
 }
 
 UnityConsole::~UnityConsole() {
 }
 
+bool UnityConsole::cmdPalette(int argc, const char **argv) {
+	debugPrintf("palette uploads/sec: %d\n", _vm->_gfx->getPaletteUploadRate());
+	return true;
+}
+
+bool UnityConsole::cmdPolygons(int argc, const char **argv) {
+	if (argc != 2 || (strcmp(argv[1], "on") && strcmp(argv[1], "off"))) {
+		debugPrintf("Usage: %s <on|off>\n", argv[0]);
+		debugPrintf("polygon overlay is %s\n", _vm->_gfx->isPolygonOverlayEnabled() ? "on" : "off");
+		return true;
+	}
+
+	_vm->_gfx->setPolygonOverlayEnabled(!strcmp(argv[1], "on"));
+	return true;
+}
+
+bool UnityConsole::cmdComposite(int argc, const char **argv) {
+	if (argc != 2 || strcmp(argv[1], "check")) {
+		debugPrintf("Usage: %s check\n", argv[0]);
+		return true;
+	}
+
+	// the result is logged once the next frame has been composited
+	_vm->_gfx->requestCompositeCheck();
+	return false;
+}
+
+bool UnityConsole::cmdBenchmark(int argc, const char **argv) {
+	if (argc > 3 || (argc == 3 && strcmp(argv[2], "present"))) {
+		debugPrintf("Usage: %s [frames] [present]\n", argv[0]);
+		debugPrintf("(only from the bridge; every screen is visited, which may change game state)\n");
+		return true;
+	}
+
+	int frames = 100;
+	if (argc >= 2)
+		frames = atoi(argv[1]);
+	if (frames < 1) {
+		debugPrintf("frame count must be positive\n");
+		return true;
+	}
+
+	// this runs from the main loop, once the console is closed; results go to stdout
+	if (!_vm->requestBenchmark(frames, argc == 3)) {
+		debugPrintf("the benchmark can only be run from the bridge, with no away team\n");
+		return true;
+	}
+	return false;
+}
+
+bool UnityConsole::cmdDecoders(int argc, const char **argv) {
+	if (argc > 2) {
+		debugPrintf("Usage: %s [spr|spt|mrg|fvf|rac]\n", argv[0]);
+		return true;
+	}
+
+	// this doesn't touch any game state, so can run right away
+	_vm->runDecoderBenchmark(argc == 2 ? argv[1] : "");
+	debugPrintf("done; results are on stdout\n");
+	return true;
+}
+
+bool UnityConsole::cmdSfx(int argc, const char **argv) {
+	for (uint i = 0; i < kSfxVoiceCount; i++) {
+		const Sound::SfxVoice &voice = _vm->_snd->getSfxVoice(i);
+		debugPrintf("voice %d: %s, priority %d, %d sounds, %d cut off\n", i,
+			_vm->_snd->sfxVoicePlaying(i) ? "playing" : "idle",
+			voice.priority, voice.plays, voice.stolen);
+	}
+	debugPrintf("%d sounds dropped with no voice free\n", _vm->_snd->getSfxDropped());
+	return true;
+}
+
 } // End of namespace Unity
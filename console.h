@@ -36,6 +36,13 @@ public:
 
 private:
 	UnityEngine *_vm;
+
+	bool cmdPalette(int argc, const char **argv);
+	bool cmdPolygons(int argc, const char **argv);
+	bool cmdComposite(int argc, const char **argv);
+	bool cmdBenchmark(int argc, const char **argv);
+	bool cmdDecoders(int argc, const char **argv);
+	bool cmdSfx(int argc, const char **argv);
 };
 
 } // End of namespace Unity
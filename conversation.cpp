@@ -388,6 +388,26 @@ void Response::execute(UnityEngine *_vm, Object *speaker, Conversation *src) {
 	debug(1, "***end execute***");
 }
 
+// the voice files execute will play, in order
+void Response::addSpeech(UnityEngine *_vm, objectID speaker, Common::Array<Common::String> &files) {
+	if (text.size() && voice_group != 0xcc)
+		files.push_back(_vm->voiceFileFor(voice_group, voice_subgroup, speaker, voice_id));
+
+	objectID targetid = speaker;
+	if (target.id != 0xff) {
+		targetid = target;
+		if (target.world == 0 && target.screen == 0 && (target.id >= 0x20 && target.id <= 0x28))
+			targetid.id -= 0x20; // (see execute)
+	}
+
+	if (!textblocks.size())
+		return;
+	TextBlock *textblock = textblocks[0];
+	if (textblock->text.size())
+		files.push_back(_vm->voiceFileFor(textblock->voice_group, textblock->voice_subgroup,
+			targetid, textblock->voice_id));
+}
+
 Response *Conversation::getEnabledResponse(UnityEngine *_vm, unsigned int response, objectID speaker) {
 	for (unsigned int i = 0; i < responses.size(); i++) {
 		if (responses[i]->id != response) continue;
@@ -424,6 +444,21 @@ void Conversation::execute(UnityEngine *_vm, Object *speaker, unsigned int situa
 		}
 		if (!resp) error("couldn't find active response for situation %d", situation);
 
+		// what this response says, and then what the responses which could
+		// follow it say, so the sound code can get those ready in advance
+		Common::Array<Common::String> speech;
+		resp->addSpeech(_vm, speaker->id, speech);
+		if (resp->next_situation != 0xffff) {
+			for (unsigned int i = 0; i < responses.size(); i++) {
+				if (responses[i]->id == resp->next_situation &&
+					responses[i]->response_state == RESPONSE_ENABLED &&
+					responses[i]->validFor(_vm, speaker->id)) {
+					responses[i]->addSpeech(_vm, speaker->id, speech);
+				}
+			}
+		}
+		_vm->_snd->expectSpeech(speech);
+
 		resp->execute(_vm, speaker, this);
 
 		_vm->_dialog_choice_states.clear();
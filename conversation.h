@@ -96,6 +96,7 @@ public:
 	bool validFor(UnityEngine *_vm, objectID speaker);
 	void readFrom(Common::SeekableReadStream *stream);
 	void execute(UnityEngine *_vm, Object *speaker, Conversation *src);
+	void addSpeech(UnityEngine *_vm, objectID speaker, Common::Array<Common::String> &files);
 };
 
 class Conversation {
@@ -24,8 +24,15 @@
 #include "common/macresman.h"
 #include "common/fs.h"
 #include "common/config-manager.h"
+#include "common/file.h"
 #include "common/textconsole.h"
+#include "common/util.h"
 #include "trigger.h"
+#include "graphics.h"
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
 
 namespace Unity {
 
@@ -111,6 +118,126 @@ void UnityData::loadScreenPolys(Common::String filename) {
 	}
 
 	delete mrgStream;
+
+	buildWalkableIndex();
+	_vm->_gfx->updatePolygonOverlay();
+}
+
+void UnityData::clearScreenPolys() {
+	_currentScreen.polygons.clear();
+	_currentScreen.walkableCellStart.clear();
+	_currentScreen.walkableRefs.clear();
+	_vm->_gfx->updatePolygonOverlay();
+}
+
+#define DIRECTION(x, y, x1, y1, x2, y2) (((int)y - y1)*(x2 - x1) - ((int)x - x1)*(y2 - y1))
+
+bool Triangle::contains(int x, int y) const {
+	int direction = DIRECTION(x, y, points[0].x, points[0].y, points[1].x, points[1].y);
+	bool neg = direction < 0;
+	direction = DIRECTION(x, y, points[1].x, points[1].y, points[2].x, points[2].y);
+	if ((direction < 0) != neg) return false;
+	direction = DIRECTION(x, y, points[2].x, points[2].y, points[0].x, points[0].y);
+	if ((direction < 0) != neg) return false;
+	return true;
+}
+
+// the grid covers the 640x480 screen
+enum {
+	kWalkableCellSize = 32,
+	kWalkableGridWidth = 640 / kWalkableCellSize,
+	kWalkableGridHeight = 480 / kWalkableCellSize
+};
+
+static void walkableCellBounds(const Triangle &tri, int &x1, int &y1, int &x2, int &y2) {
+	int minx = MIN(tri.points[0].x, MIN(tri.points[1].x, tri.points[2].x));
+	int maxx = MAX(tri.points[0].x, MAX(tri.points[1].x, tri.points[2].x));
+	int miny = MIN(tri.points[0].y, MIN(tri.points[1].y, tri.points[2].y));
+	int maxy = MAX(tri.points[0].y, MAX(tri.points[1].y, tri.points[2].y));
+	x1 = CLIP<int>(minx / kWalkableCellSize, 0, kWalkableGridWidth - 1);
+	x2 = CLIP<int>(maxx / kWalkableCellSize, 0, kWalkableGridWidth - 1);
+	y1 = CLIP<int>(miny / kWalkableCellSize, 0, kWalkableGridHeight - 1);
+	y2 = CLIP<int>(maxy / kWalkableCellSize, 0, kWalkableGridHeight - 1);
+}
+
+void UnityData::buildWalkableIndex() {
+	Common::Array<ScreenPolygon> &polys = _currentScreen.polygons;
+	Common::Array<uint32> &cellStart = _currentScreen.walkableCellStart;
+	Common::Array<TriangleRef> &refs = _currentScreen.walkableRefs;
+
+	// first pass counts the triangles in each cell, second pass fills them in;
+	// polygon/triangle order is kept, so lookups find the same triangle as a linear scan
+	cellStart.clear();
+	cellStart.resize(kWalkableGridWidth * kWalkableGridHeight + 1);
+	for (unsigned int i = 0; i < polys.size(); i++) {
+		if (polys[i].type != 1) continue;
+		for (unsigned int j = 0; j < polys[i].triangles.size(); j++) {
+			int x1, y1, x2, y2;
+			walkableCellBounds(polys[i].triangles[j], x1, y1, x2, y2);
+			for (int y = y1; y <= y2; y++)
+				for (int x = x1; x <= x2; x++)
+					cellStart[y * kWalkableGridWidth + x + 1]++;
+		}
+	}
+	for (unsigned int n = 1; n < cellStart.size(); n++)
+		cellStart[n] += cellStart[n - 1];
+
+	refs.clear();
+	refs.resize(cellStart[cellStart.size() - 1]);
+	Common::Array<uint32> fill(&cellStart[0], cellStart.size() - 1);
+	for (unsigned int i = 0; i < polys.size(); i++) {
+		if (polys[i].type != 1) continue;
+		for (unsigned int j = 0; j < polys[i].triangles.size(); j++) {
+			int x1, y1, x2, y2;
+			walkableCellBounds(polys[i].triangles[j], x1, y1, x2, y2);
+			for (int y = y1; y <= y2; y++) {
+				for (int x = x1; x <= x2; x++) {
+					TriangleRef &ref = refs[fill[y * kWalkableGridWidth + x]++];
+					ref.polygon = i;
+					ref.triangle = j;
+				}
+			}
+		}
+	}
+}
+
+bool UnityData::findWalkable(unsigned int x, unsigned int y, WalkableHit &hit) {
+	Common::Array<uint32> &cellStart = _currentScreen.walkableCellStart;
+	if (cellStart.empty())
+		return false;
+
+	unsigned int cell = MIN<unsigned int>(y / kWalkableCellSize, kWalkableGridHeight - 1) * kWalkableGridWidth
+		+ MIN<unsigned int>(x / kWalkableCellSize, kWalkableGridWidth - 1);
+	for (unsigned int n = cellStart[cell]; n < cellStart[cell + 1]; n++) {
+		const TriangleRef &ref = _currentScreen.walkableRefs[n];
+		const Triangle &tri = _currentScreen.polygons[ref.polygon].triangles[ref.triangle];
+		if (!tri.contains(x, y))
+			continue;
+
+		hit.polygon = ref.polygon;
+		hit.triangle = ref.triangle;
+
+		const Common::Point &p0 = tri.points[0], &p1 = tri.points[1], &p2 = tri.points[2];
+		int denom = (p1.y - p2.y) * (p0.x - p2.x) + (p2.x - p1.x) * (p0.y - p2.y);
+		if (denom == 0) {
+			// degenerate triangle, just use the first vertex
+			hit.weights[0] = 256;
+			hit.weights[1] = hit.weights[2] = 0;
+			hit.distance = tri.distances[0];
+			return true;
+		}
+		int n0 = (p1.y - p2.y) * ((int)x - p2.x) + (p2.x - p1.x) * ((int)y - p2.y);
+		int n1 = (p2.y - p0.y) * ((int)x - p2.x) + (p0.x - p2.x) * ((int)y - p2.y);
+		int n2 = denom - n0 - n1;
+
+		hit.weights[0] = (n0 * 256) / denom;
+		hit.weights[1] = (n1 * 256) / denom;
+		hit.weights[2] = 256 - hit.weights[0] - hit.weights[1];
+		hit.distance = (n0 * tri.distances[0] + n1 * tri.distances[1] + n2 * tri.distances[2]) / denom;
+		return true;
+	}
+
+	return false;
 }
 
 void UnityData::loadTriggers() {
@@ -196,8 +323,257 @@ Trigger *UnityData::getTrigger(uint32 id) {
 	return NULL;
 }
 
+enum {
+	// zip members at least this big are inflated as they're read
+	kStreamedMemberSize = 256 * 1024,
+
+	// how much compressed data a streamed member reads at a time
+	kInflateInputSize = 16 * 1024,
+	// and how much it inflates ahead of the reader
+	kInflateOutputSize = 4 * 1024
+};
+
+#ifdef USE_ZLIB
+
+// A deflated zip member, inflated on demand. Seeking forwards inflates
+// and throws away the data in between; seeking backwards starts again.
+class InflateReadStream : public Common::SeekableReadStream {
+public:
+	InflateReadStream(Common::SeekableReadStream *file, uint32 start, uint32 compressedSize, uint32 size);
+	~InflateReadStream();
+
+	bool eos() const { return _eos; }
+	bool err() const { return _err; }
+	void clearErr() { _eos = _err = false; }
+
+	uint32 read(void *dataPtr, uint32 dataSize);
+	int32 pos() const { return _pos; }
+	int32 size() const { return _size; }
+	bool seek(int32 offset, int whence = SEEK_SET);
+
+protected:
+	Common::SeekableReadStream *_file;
+	uint32 _start, _compressedSize, _size;
+
+	z_stream _zStream;
+	uint32 _compressedPos; // how much input we've read so far
+	byte _inBuffer[kInflateInputSize];
+	byte _outBuffer[kInflateOutputSize];
+	uint32 _outPos, _outSize;
+
+	uint32 _pos;
+	bool _eos, _err, _finished;
+
+	void restart();
+	bool fillOutput();
+};
+
+InflateReadStream::InflateReadStream(Common::SeekableReadStream *file, uint32 start, uint32 compressedSize, uint32 size)
+	: _file(file), _start(start), _compressedSize(compressedSize), _size(size), _eos(false), _err(false) {
+	memset(&_zStream, 0, sizeof(_zStream));
+	// (zip members are raw deflate data, without a zlib header)
+	if (inflateInit2(&_zStream, -MAX_WBITS) != Z_OK)
+		_err = true;
+	restart();
+}
+
+InflateReadStream::~InflateReadStream() {
+	inflateEnd(&_zStream);
+	delete _file;
+}
+
+void InflateReadStream::restart() {
+	inflateReset(&_zStream);
+	_zStream.avail_in = 0;
+	_compressedPos = 0;
+	_outPos = _outSize = 0;
+	_pos = 0;
+	_finished = false;
+}
+
+bool InflateReadStream::fillOutput() {
+	_outPos = _outSize = 0;
+	if (_finished || _err)
+		return false;
+
+	_zStream.next_out = _outBuffer;
+	_zStream.avail_out = kInflateOutputSize;
+	while (_zStream.avail_out == kInflateOutputSize) {
+		if (!_zStream.avail_in) {
+			uint32 count = MIN<uint32>(kInflateInputSize, _compressedSize - _compressedPos);
+			if (!count) {
+				// ran out of input before the end of the deflate stream
+				_err = true;
+				break;
+			}
+			_file->seek(_start + _compressedPos);
+			count = _file->read(_inBuffer, count);
+			_compressedPos += count;
+			_zStream.next_in = _inBuffer;
+			_zStream.avail_in = count;
+		}
+
+		int result = inflate(&_zStream, Z_NO_FLUSH);
+		if (result == Z_STREAM_END) {
+			_finished = true;
+			break;
+		}
+		if (result != Z_OK) {
+			warning("inflate failed (%d) at %d", result, _pos);
+			_err = true;
+			break;
+		}
+	}
+
+	_outSize = kInflateOutputSize - _zStream.avail_out;
+	return _outSize != 0;
+}
+
+uint32 InflateReadStream::read(void *dataPtr, uint32 dataSize) {
+	byte *dest = (byte *)dataPtr;
+	uint32 total = 0;
+	while (total < dataSize) {
+		if (_outPos == _outSize && !fillOutput()) {
+			_eos = true;
+			break;
+		}
+		uint32 count = MIN(dataSize - total, _outSize - _outPos);
+		memcpy(dest + total, _outBuffer + _outPos, count);
+		_outPos += count;
+		total += count;
+	}
+	_pos += total;
+	return total;
+}
+
+bool InflateReadStream::seek(int32 offset, int whence) {
+	int32 target = offset;
+	if (whence == SEEK_CUR)
+		target += _pos;
+	else if (whence == SEEK_END)
+		target += _size;
+	if (target < 0 || target > (int32)_size)
+		return false;
+
+	if ((uint32)target < _pos) {
+		if (_pos - target <= _outPos) {
+			// still in the read-ahead
+			_outPos -= _pos - target;
+			_pos = target;
+		} else {
+			restart();
+		}
+	}
+
+	while (_pos < (uint32)target) {
+		if (_outPos == _outSize && !fillOutput())
+			return false;
+		uint32 count = MIN<uint32>(target - _pos, _outSize - _outPos);
+		_outPos += count;
+		_pos += count;
+	}
+
+	_eos = false;
+	return true;
+}
+
+#endif
+
+// whether SearchMan has a copy of the file outside our zip files, in which
+// case openFile shouldn't stream the zip member instead
+bool UnityData::isLooseFile(const Common::String &filename) {
+	Common::ArchiveMemberList list;
+	int zipCount = 0;
+	if (_data && _data->hasFile(filename))
+		zipCount++;
+	if (_instData && _instData->hasFile(filename))
+		zipCount++;
+	return SearchMan.listMatchingMembers(list, filename) > zipCount;
+}
+
+// note the large members of a zip file, from its central directory
+void UnityData::indexZipFile(const Common::String &filename) {
+	Common::File file;
+	if (!file.open(filename))
+		return;
+
+	// the end of central directory record (ignoring any comment)
+	file.seek(-22, SEEK_END);
+	if (file.readUint32LE() != 0x06054b50) {
+		warning("couldn't find the central directory of '%s'", filename.c_str());
+		return;
+	}
+	file.skip(6);
+	uint16 count = file.readUint16LE();
+	file.skip(4); // directory size
+	uint32 offset = file.readUint32LE();
+
+	file.seek(offset);
+	for (uint i = 0; i < count; i++) {
+		if (file.readUint32LE() != 0x02014b50)
+			error("bad central directory entry in '%s'", filename.c_str());
+		file.skip(6);
+		ZipMember member;
+		member.archive = filename;
+		member.method = file.readUint16LE();
+		file.skip(8); // time, date, crc
+		member.compressedSize = file.readUint32LE();
+		member.size = file.readUint32LE();
+		uint16 nameLength = file.readUint16LE();
+		uint16 extraLength = file.readUint16LE();
+		uint16 commentLength = file.readUint16LE();
+		file.skip(8);
+		member.offset = file.readUint32LE();
+
+		char *name = new char[nameLength + 1];
+		file.read(name, nameLength);
+		name[nameLength] = 0;
+		file.skip(extraLength + commentLength);
+
+		bool supported = member.method == 0;
+#ifdef USE_ZLIB
+		supported = supported || member.method == 8;
+#endif
+		// (if a file is in both archives, the first one wins)
+		if (supported && member.size >= kStreamedMemberSize && !_streamedMembers.contains(name)
+			&& !isLooseFile(name))
+			_streamedMembers[name] = member;
+		delete[] name;
+	}
+}
+
+Common::SeekableReadStream *UnityData::openStreamedMember(const ZipMember &member) {
+	Common::File *file = new Common::File();
+	if (!file->open(member.archive)) {
+		delete file;
+		return NULL;
+	}
+
+	// skip the local header, which can have different extra data
+	file->seek(member.offset);
+	if (file->readUint32LE() != 0x04034b50)
+		error("bad local header in '%s'", member.archive.c_str());
+	file->skip(22);
+	uint16 nameLength = file->readUint16LE();
+	uint16 extraLength = file->readUint16LE();
+	uint32 start = member.offset + 30 + nameLength + extraLength;
+
+#ifdef USE_ZLIB
+	if (member.method == 8)
+		return new InflateReadStream(file, start, member.compressedSize, member.size);
+#endif
+	return new Common::SeekableSubReadStream(file, start, start + member.size, DisposeAfterUse::YES);
+}
+
 Common::SeekableReadStream *UnityData::openFile(Common::String filename) {
-	Common::SeekableReadStream *stream = SearchMan.createReadStreamForMember(filename);
+	Common::SeekableReadStream *stream;
+	if (_streamedMembers.contains(filename)) {
+		stream = openStreamedMember(_streamedMembers[filename]);
+		if (stream)
+			return stream;
+	}
+
+	stream = SearchMan.createReadStreamForMember(filename);
 	if (stream)
 		return stream;
 
@@ -211,6 +587,12 @@ Common::SeekableReadStream *UnityData::openFile(Common::String filename) {
 	error("couldn't open '%s'", filename.c_str());
 }
 
+// whether openFile would find the file
+bool UnityData::hasFile(const Common::String &filename) {
+	return _streamedMembers.contains(filename) || SearchMan.hasFile(filename)
+		|| Common::MacResManager::exists(filename);
+}
+
 void UnityData::loadSpriteFilenames() {
 	Common::SeekableReadStream *stream = openFile("sprite.lst");
 
@@ -21,6 +21,7 @@
 #include "common/archive.h"
 #include "common/rect.h"
 #include "common/hashmap.h"
+#include "common/hash-str.h"
 
 #include "object.h"
 #include "origdata.h"
@@ -36,6 +37,19 @@ class Trigger;
 struct Triangle {
 	Common::Point points[3];
 	uint16 distances[3];
+
+	bool contains(int x, int y) const;
+};
+
+struct TriangleRef {
+	uint16 polygon, triangle;
+};
+
+// a point inside a walkable triangle, with barycentric weights (summing to 256)
+struct WalkableHit {
+	unsigned int polygon, triangle;
+	unsigned int weights[3];
+	unsigned int distance; // interpolated from the three vertex distances
 };
 
 struct ScreenPolygon {
@@ -57,6 +71,11 @@ struct Screen {
 
 	Common::Array<ScreenPolygon> polygons;
 	Common::Array<Object *> objects;
+
+	// uniform grid over the walkable (type 1) triangles: the triangles
+	// touching cell n are walkableRefs[walkableCellStart[n]..walkableCellStart[n + 1]]
+	Common::Array<uint32> walkableCellStart;
+	Common::Array<TriangleRef> walkableRefs;
 };
 
 struct ComputerEntry {
@@ -71,6 +90,8 @@ class UnityData {
 protected:
 	class UnityEngine *_vm;
 
+	void buildWalkableIndex();
+
 public:
 	UnityData(UnityEngine *p) : _vm(p) { }
 	~UnityData();
@@ -78,10 +99,26 @@ public:
 	// data file access
 	Common::Archive *_data, *_instData;
 	Common::SeekableReadStream *openFile(Common::String filename);
+	bool hasFile(const Common::String &filename);
+
+	// large zip members, which openFile inflates as they're read rather
+	// than all at once (the archive code would do the latter)
+	struct ZipMember {
+		Common::String archive;
+		uint32 offset; // of the local header
+		uint32 compressedSize, size;
+		uint16 method;
+	};
+	Common::HashMap<Common::String, ZipMember, Common::IgnoreCase_Hash, Common::IgnoreCase_EqualTo> _streamedMembers;
+	void indexZipFile(const Common::String &filename);
+	bool isLooseFile(const Common::String &filename);
+	Common::SeekableReadStream *openStreamedMember(const ZipMember &member);
 
 	// current away team screen
 	Screen _currentScreen;
 	void loadScreenPolys(Common::String filename);
+	void clearScreenPolys();
+	bool findWalkable(unsigned int x, unsigned int y, WalkableHit &hit);
 
 	// triggers
 	Common::Array<Trigger *> _triggers;
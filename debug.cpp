@@ -0,0 +1,304 @@
+/*
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "unity.h"
+#include "fvf_decoder.h"
+#include "graphics.h"
+#include "sound.h"
+#include "sprite.h"
+
+#include "common/algorithm.h"
+#include "common/archive.h"
+#include "common/events.h"
+#include "common/system.h"
+#include "common/textconsole.h"
+#include "common/util.h"
+#include "graphics/surface.h"
+#include "audio/audiostream.h"
+
+namespace Unity {
+
+// the benchmark advances sprites by this much animation time per frame
+static const uint32 kBenchmarkFrameTime = 1000 / 15;
+
+// p'th percentile of an already-sorted array
+static uint32 percentile(const Common::Array<uint32> &sorted, unsigned int p) {
+	if (sorted.empty())
+		return 0;
+	return sorted[((sorted.size() - 1) * p) / 100];
+}
+
+// The benchmark visits every screen and ends on the bridge, dropping any away
+// team and inventory, so only start it from the bridge.
+bool UnityEngine::requestBenchmark(unsigned int frames, bool present) {
+	if (_on_away_team || _currScreenType != BridgeScreenType)
+		return false;
+
+	_benchmarkFrames = frames;
+	_benchmarkPresent = present;
+	return true;
+}
+
+// render the current screen a fixed number of times, and describe it as one line of JSON
+Common::String UnityEngine::benchmarkScreen(const Common::String &name, uint32 loadTime,
+	unsigned int frames, bool present, ::Graphics::Surface *surface) {
+	Common::Array<uint32> times;
+	uint32 total = 0;
+	uint32 peakCache = _gfx->getCacheSize();
+
+	uint32 clock = _system->getMillis();
+	for (unsigned int f = 0; f < frames && !shouldQuit(); f++) {
+		// keep the backend responsive, but ignore the input
+		Common::Event event;
+		while (_eventMan->pollEvent(event)) { }
+
+		uint32 start = _system->getMillis();
+		updateSprites(clock);
+		recordFrame(false);
+		_gfx->renderFrame(present ? NULL : surface);
+		if (present)
+			_system->updateScreen();
+		uint32 time = _system->getMillis() - start;
+
+		times.push_back(time);
+		total += time;
+		clock += kBenchmarkFrameTime;
+		peakCache = MAX(peakCache, _gfx->getCacheSize());
+	}
+	Common::sort(times.begin(), times.end());
+
+	// The animation clock has run ahead of real time; bring everything
+	// which was animating back, so it doesn't sit frozen afterwards.
+	rebaseSprites(clock, _system->getMillis());
+
+	return Common::String::format("{\"screen\":\"%s\",\"load_ms\":{\"total\":%d,\"background\":%d,"
+		"\"polygons\":%d,\"objects\":%d,\"sprites\":%d},\"frames\":%d,\"frame_ms\":{\"mean\":%.2f,"
+		"\"p50\":%d,\"p90\":%d,\"p99\":%d,\"max\":%d},\"cache_kb_peak\":%d}",
+		name.c_str(), loadTime, _loadTimings.background, _loadTimings.polygons,
+		_loadTimings.objects, _loadTimings.sprites, times.size(),
+		times.empty() ? 0.0 : (double)total / times.size(),
+		percentile(times, 50), percentile(times, 90), percentile(times, 99),
+		times.empty() ? 0 : times[times.size() - 1], peakCache / 1024);
+}
+
+// load every screen in turn, render some frames of each, and report timings on stdout
+void UnityEngine::runBenchmark(unsigned int frames, bool present) {
+	_benchmarking = true;
+
+	::Graphics::Surface surface;
+	surface.create(640, 480, ::Graphics::PixelFormat::createFormatCLUT8());
+
+	// the bridge screens first
+	static const struct {
+		ScreenType type;
+		const char *name;
+	} uiScreens[] = {
+		{ BridgeScreenType, "bridge" },
+		{ ComputerScreenType, "computer" },
+		{ ViewscreenScreenType, "viewscreen" }
+	};
+
+	endAwayTeam();
+	for (int i = 0; i < ARRAYSIZE(uiScreens) && !shouldQuit(); i++) {
+		memset(&_loadTimings, 0, sizeof(_loadTimings));
+		uint32 start = _system->getMillis();
+		changeToScreen(uiScreens[i].type);
+		uint32 loadTime = _system->getMillis() - start;
+
+		Common::String line = benchmarkScreen(uiScreens[i].name, loadTime, frames, present, &surface);
+		debug("%s", line.c_str());
+	}
+
+	// then every away team screen
+	unsigned int world = 2, screen = 1;
+	do {
+		memset(&_loadTimings, 0, sizeof(_loadTimings));
+		uint32 start = _system->getMillis();
+		startAwayTeam(world, screen);
+		uint32 loadTime = _system->getMillis() - start;
+
+		Common::String name = Common::String::format("away:%d/%d", world, screen);
+		Common::String line = benchmarkScreen(name, loadTime, frames, present, &surface);
+		debug("%s", line.c_str());
+
+		stepDebugScreen(world, screen);
+	} while ((world != 2 || screen != 1) && !shouldQuit());
+
+	surface.free();
+	_benchmarking = false;
+
+	startBridge();
+}
+
+static uint32 adler32(uint32 adler, const byte *data, uint32 len) {
+	uint32 a = adler & 0xffff, b = adler >> 16;
+	while (len--) {
+		a = (a + *data++) % 65521;
+		b = (b + a) % 65521;
+	}
+	return (b << 16) | a;
+}
+
+// what one decoder run produced
+struct DecodeResult {
+	uint32 outBytes;
+	uint32 frames;
+	uint32 samples; // audio samples decoded (all channels)
+	// Roughly how much decoded output the decoder holds at once: all of a
+	// sprite's or MRG's images, one FVF frame, one RAC buffer. This is an
+	// estimate, not measured allocation; decoder internals aren't counted.
+	uint32 heldBytesEstimate;
+	uint32 checksum;
+};
+
+// each of these takes the stream
+
+static void decodeSprite(Graphics *gfx, Common::SeekableReadStream *stream, DecodeResult &result) {
+	Sprite sprite(stream);
+	for (unsigned int i = 0; i < sprite.getNumEntries(); i++) {
+		SpriteEntry *entry = sprite.getEntry(i);
+		if (entry->type == se_Sprite || entry->type == se_SpeechSprite) {
+			SpriteEntrySprite *frame = (SpriteEntrySprite *)entry;
+			uint32 size = frame->width * frame->height;
+			result.checksum = adler32(result.checksum, frame->data, size);
+			result.outBytes += size;
+			result.frames++;
+		} else if (entry->type == se_Audio) {
+			SpriteEntryAudio *audio = (SpriteEntryAudio *)entry;
+			result.checksum = adler32(result.checksum, audio->data, audio->length);
+			result.outBytes += audio->length;
+		}
+	}
+	result.heldBytesEstimate = result.outBytes;
+
+	delete stream;
+}
+
+static void decodeMRG(Graphics *gfx, Common::SeekableReadStream *stream, DecodeResult &result) {
+	MRGFile mrg;
+	gfx->readMRG(stream, &mrg);
+	for (unsigned int j = 0; j < mrg.data.size(); j++) {
+		uint32 size = mrg.widths[j] * mrg.heights[j];
+		result.checksum = adler32(result.checksum, mrg.data[j], size);
+		result.outBytes += size;
+		result.frames++;
+	}
+	result.heldBytesEstimate = result.outBytes;
+
+	delete stream;
+}
+
+static void decodeFVF(Graphics *gfx, Common::SeekableReadStream *stream, DecodeResult &result) {
+	FVFDecoder decoder(g_system->getMixer());
+	// nothing plays the audio, so it would only pile up
+	decoder.setAudioEnabled(false);
+	decoder.loadStream(stream);
+
+	// (the decoder can't decode past the last frame, so stop one short)
+	for (int i = 1; i < decoder.getFrameCount(); i++) {
+		const ::Graphics::Surface *surf = decoder.internalDecodeNextFrame();
+		if (!surf)
+			continue;
+		uint32 size = surf->pitch * surf->h;
+		result.checksum = adler32(result.checksum, (const byte *)surf->getPixels(), size);
+		result.outBytes += size;
+		result.frames++;
+		result.heldBytesEstimate = size;
+	}
+}
+
+static void decodeRAC(Graphics *gfx, Common::SeekableReadStream *stream, DecodeResult &result) {
+	Audio::AudioStream *audio = makeUnityADPCMStream(stream, DisposeAfterUse::YES, stream->size(), 2);
+
+	int16 buffer[4096];
+	while (!audio->endOfData()) {
+		int samples = audio->readBuffer(buffer, ARRAYSIZE(buffer));
+		if (samples <= 0)
+			break;
+		result.checksum = adler32(result.checksum, (const byte *)buffer, samples * 2);
+		result.outBytes += samples * 2;
+		result.samples += samples;
+	}
+	result.heldBytesEstimate = sizeof(buffer);
+
+	delete audio;
+}
+
+// decode every sprite, MRG, FVF and RAC in the data files, reporting on stdout
+void UnityEngine::runDecoderBenchmark(const Common::String &type) {
+	static const struct {
+		const char *name; // (also the file extension)
+		void (*decode)(Graphics *gfx, Common::SeekableReadStream *stream, DecodeResult &result);
+	} types[] = {
+		{ "spr", decodeSprite },
+		{ "spt", decodeSprite },
+		{ "mrg", decodeMRG },
+		{ "fvf", decodeFVF },
+		{ "rac", decodeRAC }
+	};
+
+	Common::ArchiveMemberList members;
+	data._data->listMembers(members);
+	if (data._instData)
+		data._instData->listMembers(members);
+
+	for (int t = 0; t < ARRAYSIZE(types); t++) {
+		if (!type.empty() && type != types[t].name)
+			continue;
+
+		uint32 totalIn = 0, totalOut = 0, totalFrames = 0, totalSamples = 0, totalTime = 0, files = 0;
+		uint32 peakHeld = 0;
+		Common::String suffix = Common::String(".") + types[t].name;
+		for (Common::ArchiveMemberList::const_iterator i = members.begin(); i != members.end(); i++) {
+			Common::String filename = (*i)->getName();
+			filename.toLowercase();
+			if (!filename.hasSuffix(suffix.c_str()))
+				continue;
+
+			DecodeResult result;
+			result.outBytes = result.frames = result.samples = result.heldBytesEstimate = 0;
+			result.checksum = 1;
+
+			Common::SeekableReadStream *stream = (*i)->createReadStream();
+			uint32 inBytes = stream->size();
+			uint32 start = _system->getMillis();
+			types[t].decode(_gfx, stream, result);
+			uint32 time = _system->getMillis() - start;
+
+			debug("{\"file\":\"%s\",\"type\":\"%s\",\"in_bytes\":%d,\"out_bytes\":%d,\"frames\":%d,"
+				"\"ms\":%d,\"held_kb_estimate\":%d,\"checksum\":\"%08x\"}",
+				filename.c_str(), types[t].name, inBytes, result.outBytes, result.frames,
+				time, result.heldBytesEstimate / 1024, result.checksum);
+
+			files++;
+			totalIn += inBytes;
+			totalOut += result.outBytes;
+			totalFrames += result.frames;
+			totalSamples += result.samples;
+			totalTime += time;
+			peakHeld = MAX(peakHeld, result.heldBytesEstimate);
+		}
+
+		// (throughput is over the compressed input)
+		double seconds = MAX<uint32>(totalTime, 1) / 1000.0;
+		debug("{\"summary\":\"%s\",\"files\":%d,\"in_bytes\":%d,\"out_bytes\":%d,\"ms\":%d,"
+			"\"mb_per_s\":%.2f,\"frames_per_s\":%.1f,\"samples_per_s\":%.0f,\"peak_held_kb_estimate\":%d}",
+			types[t].name, files, totalIn, totalOut, totalTime, totalIn / (1024.0 * 1024.0) / seconds,
+			totalFrames / seconds, totalSamples / seconds, peakHeld / 1024);
+	}
+}
+
+} // Unity
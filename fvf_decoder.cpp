@@ -25,15 +25,52 @@
 
 namespace Unity {
 
+enum {
+	kFrameBufferSize = 64000,
+	kColourBufferSize = 32000
+};
+
+uint32 FVFDecoder::block_id_to_offset[6000];
+uint32 FVFDecoder::block_status_lookup[6000];
+uint16 FVFDecoder::block_lookup[16000];
+byte FVFDecoder::modify_lookup[32768];
+bool FVFDecoder::_tablesReady = false;
+
 FVFDecoder::FVFDecoder(Audio::Mixer *mixer, Audio::Mixer::SoundType soundType) {
 	_mixer = mixer;
 	_soundType = soundType;
 
 	_fileStream = NULL;
+	_audioStream = NULL;
+	_skipAudio = false;
+	_audioEnabled = true;
+	_indexEnd = _indexFrames = _lastDataOffset = 0;
+	_indexComplete = false;
+
+	_frameBuffers = NULL;
+
+	memset(_palette, 0, sizeof(_palette));
+	_dirtyPalette = false;
+	_convertAll = false;
+
+	_blockData = NULL;
+	_blockSize = _blockCapacity = _blockPos = 0;
+
+	for (unsigned int i = 0; i < kAudioBufferCount; i++) {
+		_audioBuffers[i] = NULL;
+		_audioBufferSizes[i] = 0;
+	}
+	_nextAudioBuffer = 0;
+
+	setOutputPixelFormat(::Graphics::PixelFormat(3, 8, 8, 8, 0, 16, 8, 0, 0));
 }
 
 FVFDecoder::~FVFDecoder() {
 	close();
+
+	free(_blockData);
+	for (unsigned int i = 0; i < kAudioBufferCount; i++)
+		free(_audioBuffers[i]);
 }
 
 bool FVFDecoder::loadStream(Common::SeekableReadStream *stream) {
@@ -51,8 +88,7 @@ bool FVFDecoder::loadStream(Common::SeekableReadStream *stream) {
 
 	// *** offsets to data/headers
 	uint32 data_offset = _fileStream->readUint32LE();
-	uint32 last_data_offset = _fileStream->readUint32LE();
-	(void)last_data_offset; // offset of the last block; we don't care
+	uint32 last_data_offset = _fileStream->readUint32LE(); // offset of the last block
 	uint32 header_offset = _fileStream->readUint32LE();
 	uint32 audio_header_offset = _fileStream->readUint32LE();
 	// (64 obviously junk bytes are here)
@@ -119,13 +155,35 @@ bool FVFDecoder::loadStream(Common::SeekableReadStream *stream) {
 
 	// *** header palette entries
 	_fileStream->seek(header_pal_offset);
-	// we don't support rendering in paletted mode
-	_fileStream->skip(3 * header_pal_count);
+	if (_pixelFormat.bytesPerPixel == 1) {
+		memset(_palette, 0, sizeof(_palette));
+		memset(_colourMap, 0, sizeof(_colourMap));
+		// TODO: assumed to be 6-bit, like every other palette in the game
+		for (unsigned int i = 0; i < 3 * header_pal_count; i++)
+			_palette[i] = _fileStream->readByte() << 2;
+		updateColourMap(0, header_pal_count + palette_entry_count);
+		_dirtyPalette = true;
+	} else {
+		_fileStream->skip(3 * header_pal_count);
+	}
 
 	debug(1, "read FVF video header: video %dx%d (%d bpp)", _width, _height, _bpp);
 
 	setupTables();
 
+	_frameBuffers = new byte[2 * kFrameBufferSize + 2 * kColourBufferSize];
+	real_front_buffer = _frameBuffers;
+	real_back_buffer = real_front_buffer + kFrameBufferSize;
+	real_colour_front_buffer = real_back_buffer + kFrameBufferSize;
+	real_colour_back_buffer = real_colour_front_buffer + kColourBufferSize;
+	resetDecoderState();
+
+	_blockIndex.clear();
+	_indexEnd = data_offset;
+	_indexFrames = 0;
+	_lastDataOffset = last_data_offset;
+	_indexComplete = false;
+
 	_fileStream->seek(data_offset);
 	readNextBlock();
 
@@ -142,26 +200,160 @@ bool FVFDecoder::loadStream(Common::SeekableReadStream *stream) {
 void FVFDecoder::close() {
 	if (!_fileStream) return;
 
+	// stop the audio track before anything it might still be playing goes away
+	::Video::VideoDecoder::close();
+	delete _audioStream;
+	_audioStream = NULL;
+
 	delete _fileStream;
+	_fileStream = NULL;
 
 	_surface.free();
+
+	delete[] _frameBuffers;
+	_frameBuffers = NULL;
+
+	_blockSize = _blockPos = 0;
+	_nextAudioBuffer = 0;
+	_changedRects.clear();
+	_blockIndex.clear();
+	_indexComplete = false;
 }
 
 void FVFDecoder::readNextBlock() {
-	uint16 curr_block_header_size = _fileStream->readUint16LE();
-	assert(curr_block_header_size == 0x10);
+	uint32 offset = _fileStream->pos();
+	byte header[0x10];
+	_fileStream->read(header, sizeof(header));
 
-	uint16 curr_block_frame_count = _fileStream->readUint16LE();
-	uint32 prev_block_size = _fileStream->readUint32LE();
-	uint32 curr_block_size = _fileStream->readUint32LE();
-	uint32 next_block_size = _fileStream->readUint32LE();
+	uint16 curr_block_header_size = READ_LE_UINT16(header);
+	assert(curr_block_header_size == 0x10);
 
-	curr_block_remaining_frames = curr_block_frame_count;
-	curr_block_remaining_size = curr_block_size - curr_block_header_size;
+	uint16 curr_block_frame_count = READ_LE_UINT16(header + 2);
+	uint32 prev_block_size = READ_LE_UINT32(header + 4);
+	uint32 curr_block_size = READ_LE_UINT32(header + 8);
+	uint32 next_block_size = READ_LE_UINT32(header + 12);
 
 	// we don't care
 	(void)prev_block_size;
 	(void)next_block_size;
+
+	curr_block_remaining_frames = curr_block_frame_count;
+
+	_blockSize = curr_block_size - curr_block_header_size;
+	_blockPos = 0;
+	if (_blockSize > _blockCapacity) {
+		free(_blockData);
+		_blockData = (byte *)malloc(_blockSize);
+		_blockCapacity = _blockSize;
+	}
+	if (_fileStream->read(_blockData, _blockSize) != _blockSize)
+		error("FVF: short read of %d byte block", _blockSize);
+
+	indexBlock(offset, header, _blockData);
+}
+
+// add a block to the index, if it's the next one we don't know about;
+// 'frame' is the start of its first frame (at least 0x1e bytes)
+void FVFDecoder::indexBlock(uint32 offset, const byte *header, const byte *frame) {
+	if (_indexComplete || offset != _indexEnd)
+		return;
+
+	uint16 frame_count = READ_LE_UINT16(header + 2);
+	uint32 block_size = READ_LE_UINT32(header + 8);
+	uint32 next_block_size = READ_LE_UINT32(header + 12);
+
+	// the frame header, then the video length and the first two words of the video
+	BlockIndexEntry entry;
+	entry.offset = offset;
+	entry.firstFrame = _indexFrames;
+	uint32 video_offset = READ_LE_UINT32(frame + 6);
+	entry.keyFrame = (video_offset != 0) && (READ_LE_UINT16(frame + 0x18 + 2 + 2) & 0x1);
+	_blockIndex.push_back(entry);
+
+	_indexFrames += frame_count;
+	_indexEnd = offset + block_size;
+	if (offset >= _lastDataOffset || !next_block_size) {
+		_indexComplete = true;
+		debug(1, "FVF: indexed %d blocks, %d frames", _blockIndex.size(), _indexFrames);
+	}
+}
+
+// index blocks (from their headers alone) until we know the one with 'frame'
+void FVFDecoder::indexAhead(uint32 frame) {
+	while (!_indexComplete && _indexFrames <= frame) {
+		_fileStream->seek(_indexEnd);
+
+		byte header[0x10 + 0x18 + 2 + 4];
+		if (_fileStream->read(header, sizeof(header)) != sizeof(header))
+			error("FVF: truncated block at %d", _indexEnd);
+		assert(READ_LE_UINT16(header) == 0x10);
+
+		indexBlock(_indexEnd, header, header + 0x10);
+	}
+}
+
+bool FVFDecoder::seekToFrame(uint32 frame) {
+	if (!_fileStream || frame >= _frameCount)
+		return false;
+
+	indexAhead(frame);
+
+	// the last key block starting at or before the frame
+	uint b = 0;
+	for (uint i = 0; i < _blockIndex.size(); i++) {
+		if (_blockIndex[i].firstFrame > frame)
+			break;
+		if (_blockIndex[i].keyFrame)
+			b = i;
+	}
+
+	resetDecoderState();
+	_fileStream->seek(_blockIndex[b].offset);
+	readNextBlock();
+	_curFrame = _blockIndex[b].firstFrame;
+
+	// fast-forward; only the frame we seeked to gets its audio
+	_skipAudio = true;
+	while (_curFrame < frame)
+		internalDecodeNextFrame();
+	_skipAudio = false;
+
+	return true;
+}
+
+bool FVFDecoder::FVFVideoTrack::seek(const Audio::Timestamp &time) {
+	return _parent->seekToFrame((_parent->_frameRate * (int)time.msecs() / 1000).toInt());
+}
+
+bool FVFDecoder::FVFAudioTrack::seek(const Audio::Timestamp &time) {
+	// the audio was stopped for the seek, so anything queued is stale
+	delete _parent->_audioStream;
+	_parent->_audioStream = _parent->createAudioStream();
+	_parent->_nextAudioBuffer = 0;
+	return true;
+}
+
+void FVFDecoder::queueAudio(const byte *data, uint32 length) {
+	// The queue plays buffers in order, so if fewer than kAudioBufferCount
+	// are still queued, the oldest one in the ring has been played.
+	if (_audioStream->numQueuedStreams() >= kAudioBufferCount) {
+		// nobody is draining the queue fast enough (or at all)
+		byte *copy = (byte *)malloc(length);
+		memcpy(copy, data, length);
+		_audioStream->queueBuffer(copy, length, DisposeAfterUse::YES, ::Audio::FLAG_UNSIGNED);
+		return;
+	}
+
+	unsigned int n = _nextAudioBuffer;
+	_nextAudioBuffer = (_nextAudioBuffer + 1) % kAudioBufferCount;
+
+	if (length > _audioBufferSizes[n]) {
+		free(_audioBuffers[n]);
+		_audioBuffers[n] = (byte *)malloc(length);
+		_audioBufferSizes[n] = length;
+	}
+	memcpy(_audioBuffers[n], data, length);
+	_audioStream->queueBuffer(_audioBuffers[n], length, DisposeAfterUse::NO, ::Audio::FLAG_UNSIGNED);
 }
 
 Graphics::Surface *FVFDecoder::internalDecodeNextFrame() {
@@ -170,61 +362,59 @@ Graphics::Surface *FVFDecoder::internalDecodeNextFrame() {
 	_curFrame++;
 	assert((unsigned int)_curFrame < _frameCount);
 
-	// this code assumes (as is the case for all FVFs encountered so far)
-	// that everything is sequential, so doesn't bother seeking around..
-
-	if (!curr_block_remaining_frames) {
-		_fileStream->skip(curr_block_remaining_size);
+	// blocks are read in order; seekToFrame repositions us at the start
+	// of a block when needed
 
+	if (!curr_block_remaining_frames)
 		readNextBlock();
-	}
 
-	uint16 header_length = _fileStream->readUint16LE();
+	assert(_blockPos + 0x18 <= _blockSize);
+	byte *frame = _blockData + _blockPos;
+
+	uint16 header_length = READ_LE_UINT16(frame);
 	assert(header_length == 0x18);
 
-	uint16 frame_length = _fileStream->readUint16LE();
-	assert(frame_length <= curr_block_remaining_size);
+	uint16 frame_length = READ_LE_UINT16(frame + 2);
+	assert(frame_length <= _blockSize - _blockPos);
 
-	uint16 unknown = _fileStream->readUint16LE();
+	uint16 unknown = READ_LE_UINT16(frame + 4);
 	(void)unknown; // TODO
 
-	uint32 video_offset = _fileStream->readUint32LE();
-	uint32 palette_offset = _fileStream->readUint32LE();
-	uint32 audio_offset = _fileStream->readUint32LE();
+	uint32 video_offset = READ_LE_UINT32(frame + 6);
+	uint32 palette_offset = READ_LE_UINT32(frame + 10);
+	uint32 audio_offset = READ_LE_UINT32(frame + 14);
 
-	uint32 unknown2 = _fileStream->readUint32LE();
+	uint32 unknown2 = READ_LE_UINT32(frame + 18);
 	(void)unknown2; // TODO
-	uint16 unknown3 = _fileStream->readUint16LE();
+	uint16 unknown3 = READ_LE_UINT16(frame + 22);
 	(void)unknown3; // TODO
 
 	uint32 read_so_far = header_length;
 
 	::Graphics::Surface *surf = NULL;
 
+	// the palette comes after the video, but we need it to convert the video
+	if (palette_offset != 0 && _pixelFormat.bytesPerPixel == 1)
+		setFramePalette(frame + palette_offset);
+
 	if (video_offset != 0) {
 		video_offset -= read_so_far;
 		assert(video_offset == 0);
 
-		uint16 video_length = _fileStream->readUint16LE();
+		uint16 video_length = READ_LE_UINT16(frame + read_so_far);
 		read_so_far += 2;
 
-		uint16 *video_frame = (uint16 *)malloc(video_length);
-		_fileStream->read(video_frame, video_length);
-
-		decodeVideoFrame(video_frame, video_length);
+		decodeVideoFrame((uint16 *)(frame + read_so_far), video_length);
 		surf = &_surface;
 
 		read_so_far += video_length;
-		free(video_frame);
 	}
 
 	if (palette_offset != 0) {
 		palette_offset -= read_so_far;
 		assert(palette_offset == 0);
 
-		// we don't support rendering in paletted mode
-		_fileStream->skip(palette_entry_count * 3);
-
+		// (already handled above)
 		read_so_far += palette_entry_count * 3;
 	}
 
@@ -232,29 +422,105 @@ Graphics::Surface *FVFDecoder::internalDecodeNextFrame() {
 		audio_offset -= read_so_far;
 		assert(audio_offset == 0);
 
-		uint32 audio_length = _fileStream->readUint32LE();
+		uint32 audio_length = READ_LE_UINT32(frame + read_so_far);
 		read_so_far += 4;
 
-		byte *audio_data = (byte *)malloc(audio_length);
-		_fileStream->read(audio_data, audio_length);
+		if (_audioEnabled && !_skipAudio)
+			queueAudio(frame + read_so_far, audio_length);
 		read_so_far += audio_length;
-
-		_audioStream->queueBuffer(audio_data, audio_length, DisposeAfterUse::YES, ::Audio::FLAG_UNSIGNED);
 	}
 
 	assert(read_so_far == frame_length);
 
 	curr_block_remaining_frames--;
-	curr_block_remaining_size -= frame_length;
+	_blockPos += frame_length;
 
 	return surf;
 }
 
-Graphics::PixelFormat FVFDecoder::getPixelFormat() const {
-	// TODO: de-hardcode this
+void FVFDecoder::setOutputPixelFormat(const ::Graphics::PixelFormat &format) {
+	assert(!_fileStream);
+	assert(format.bytesPerPixel >= 1 && format.bytesPerPixel <= 4);
+
+	_pixelFormat = format;
+
+	if (format.bytesPerPixel == 1) {
+		for (unsigned int i = 0; i < 256; i++) {
+			_redLookup[i] = (i >> 4) << 8;
+			_greenLookup[i] = (i >> 4) << 4;
+			_blueLookup[i] = i >> 4;
+		}
+		return;
+	}
+
+	for (unsigned int i = 0; i < 256; i++) {
+		_redLookup[i] = format.RGBToColor(i, 0, 0);
+		_greenLookup[i] = format.RGBToColor(0, i, 0);
+		_blueLookup[i] = format.RGBToColor(0, 0, i);
+	}
+}
+
+void FVFDecoder::setFramePalette(const byte *data) {
+	byte *pal = _palette + 3 * header_pal_count;
+
+	// the range of entries which changed
+	unsigned int first = ~0, last = 0;
+	for (unsigned int i = 0; i < 3 * palette_entry_count; i++) {
+		byte value = data[i] << 2;
+		if (pal[i] != value) {
+			pal[i] = value;
+			first = MIN(first, i / 3);
+			last = i / 3 + 1;
+		}
+	}
+	if (first == (unsigned int)~0)
+		return;
+
+	updateColourMap(header_pal_count + first, header_pal_count + last);
+	_dirtyPalette = true;
+	// every block now maps to (possibly) different entries
+	_convertAll = true;
+}
+
+static inline uint32 colourDistance(int r, int g, int b, const byte *entry) {
+	int dr = r - entry[0];
+	int dg = g - entry[1];
+	int db = b - entry[2];
+	return dr * dr + dg * dg + db * db;
+}
 
-	//return Graphics::PixelFormat(2, 5, 5, 5, 0, 0, 5, 10, 0);
-	return Graphics::PixelFormat(3, 8, 8, 8, 0, 16, 8, 0, 0);
+// Palette entries [first, last) changed: only colours which mapped to one of
+// those need searching the whole palette again, the rest just need comparing
+// against the changed entries.
+void FVFDecoder::updateColourMap(unsigned int first, unsigned int last) {
+	unsigned int count = header_pal_count + palette_entry_count;
+
+	for (unsigned int i = 0; i < 4096; i++) {
+		// the middle of this 12-bit colour's range
+		int r = ((i >> 8) << 4) + 8;
+		int g = (((i >> 4) & 0xf) << 4) + 8;
+		int b = ((i & 0xf) << 4) + 8;
+
+		unsigned int best = _colourMap[i];
+		unsigned int from = first, to = last;
+		uint32 bestDistance;
+		if (best >= first && best < last) {
+			from = 0;
+			to = count;
+			bestDistance = 0xffffffff;
+		} else {
+			bestDistance = colourDistance(r, g, b, _palette + best * 3);
+		}
+		for (unsigned int j = from; j < to; j++) {
+			uint32 distance = colourDistance(r, g, b, _palette + j * 3);
+			// (on a tie, the lowest entry, as if we'd searched everything)
+			if (distance < bestDistance || (distance == bestDistance && j < best)) {
+				best = j;
+				bestDistance = distance;
+			}
+		}
+		_colourMap[i] = best;
+	}
 }
 
 Audio::QueuingAudioStream *FVFDecoder::createAudioStream() {
@@ -341,21 +607,27 @@ void SetupBlockStatusLookup(uint32 *ptr) {
 	SetupSubsetBlockStatusLookup(ptr, ptroffset, counter, 320, 2, 2, 40, true);
 }
 
-void FVFDecoder::setupTables() {
+void FVFDecoder::resetDecoderState() {
 	memset(storage, 0, 256*2); // most likely unnecessary
 
 	curr_status = 2;
 	memset(block_status, 0, 6000);
 
-	memset(real_front_buffer, 0xAB, 64000);
-	memset(real_back_buffer, 0xAB, 64000);
-	memset(real_colour_front_buffer, 0xAB, 32000);
-	memset(real_colour_back_buffer, 0xAB, 32000);
+	memset(real_front_buffer, 0xAB, kFrameBufferSize);
+	memset(real_back_buffer, 0xAB, kFrameBufferSize);
+	memset(real_colour_front_buffer, 0xAB, kColourBufferSize);
+	memset(real_colour_back_buffer, 0xAB, kColourBufferSize);
 
 	front_buffer = real_front_buffer;
 	back_buffer = real_back_buffer;
 	colour_front_buffer = real_colour_front_buffer;
 	colour_back_buffer = real_colour_back_buffer;
+}
+
+void FVFDecoder::setupTables() {
+	if (_tablesReady)
+		return;
+	_tablesReady = true;
 
 	unsigned int a = 0;
 	for (int i = -64; i < 64; i++) {
@@ -415,10 +687,133 @@ void FVFDecoder::decodeVideoFrame(uint16 *frame, unsigned int len) {
 		}
 	}
 
-	// 24bpp only for now, because i am lazy
-	byte *source = was_front;
-	byte *source_colour = was_colour_front;
+	if (_pixelFormat.bytesPerPixel == 1)
+		convertFrame8(was_front, was_colour_front);
+	else if (_pixelFormat.bytesPerPixel == 2)
+		convertFrame<uint16>(was_front, was_colour_front);
+	else if (_pixelFormat.bytesPerPixel == 4)
+		convertFrame<uint32>(was_front, was_colour_front);
+	else
+		convertFrame24(was_front, was_colour_front);
+
+	findChangedRects();
+	_convertAll = false;
+
+	curr_status = 2;
+	if (flags & 0x4) {
+		curr_status = 3;
+	}
+}
+
+void FVFDecoder::findChangedRects() {
+	_changedRects.clear();
+
+	unsigned int i = 0;
+	for (unsigned int y = 0; y < _height/4; y++) {
+		unsigned int x = 0;
+		while (x < _width/4) {
+			// 0xf = already rendered, so unchanged since the last frame
+			if (block_status[i] == 0xf && !_convertAll) {
+				i++;
+				x++;
+				continue;
+			}
+
+			unsigned int start = x;
+			while (x < _width/4 && (block_status[i] != 0xf || _convertAll)) {
+				i++;
+				x++;
+			}
+			_changedRects.push_back(Common::Rect(start * 4, y * 4, x * 4, y * 4 + 4));
+		}
+	}
+}
+
+// The pixels in a frame are green, at full resolution, with red and blue
+// at half resolution horizontally (and shared by each pair of rows).
+template<typename PixelInt>
+void FVFDecoder::convertFrame(const byte *source, const byte *source_colour) {
+	byte *target = (byte *)_surface.getPixels();
+	unsigned int i = 0;
+	// colour is processed in 4x4 blocks
+	for (unsigned int y = 0; y < _height/4; y++) {
+		for (unsigned int x = 0; x < _width/4; x++) {
+			// 0xf = both video/colour status is 3: already rendered
+			if (block_status[i] != 0xf) {
+				byte *targ = target;
+
+				for (unsigned int j = 0; j < 4; j++) {
+					const byte *srcdata = source + (j * 320);
+
+					const byte *src_col_ptr = source_colour;
+					if (j > 1) src_col_ptr += 320;
+
+					uint32 colour1 = _redLookup[src_col_ptr[0]] | _blueLookup[src_col_ptr[160]];
+					uint32 colour2 = _redLookup[src_col_ptr[1]] | _blueLookup[src_col_ptr[161]];
+
+					PixelInt *dest = (PixelInt *)targ;
+					dest[0] = colour1 | _greenLookup[srcdata[0]];
+					dest[1] = colour1 | _greenLookup[srcdata[1]];
+					dest[2] = colour2 | _greenLookup[srcdata[2]];
+					dest[3] = colour2 | _greenLookup[srcdata[3]];
+
+					targ += _surface.pitch;
+				}
+			}
+
+			i++;
+			source += 4;
+			target += 4 * sizeof(PixelInt);
+			source_colour += 2;
+		}
+		source += 320 * 3;
+		target += _surface.pitch * 3;
+		source_colour += 160 * 3;
+	}
+}
+
+// TODO: the original's paletted mode didn't decode the colour planes at
+// all, and presumably used the other plane as palette indices somehow;
+// we just pick the nearest palette entry for each pixel instead
+void FVFDecoder::convertFrame8(const byte *source, const byte *source_colour) {
+	byte *target = (byte *)_surface.getPixels();
+	unsigned int i = 0;
+	// colour is processed in 4x4 blocks
+	for (unsigned int y = 0; y < _height/4; y++) {
+		for (unsigned int x = 0; x < _width/4; x++) {
+			if (block_status[i] != 0xf || _convertAll) {
+				byte *targ = target;
+
+				for (unsigned int j = 0; j < 4; j++) {
+					const byte *srcdata = source + (j * 320);
 
+					const byte *src_col_ptr = source_colour;
+					if (j > 1) src_col_ptr += 320;
+
+					uint32 colour1 = _redLookup[src_col_ptr[0]] | _blueLookup[src_col_ptr[160]];
+					uint32 colour2 = _redLookup[src_col_ptr[1]] | _blueLookup[src_col_ptr[161]];
+
+					targ[0] = _colourMap[colour1 | _greenLookup[srcdata[0]]];
+					targ[1] = _colourMap[colour1 | _greenLookup[srcdata[1]]];
+					targ[2] = _colourMap[colour2 | _greenLookup[srcdata[2]]];
+					targ[3] = _colourMap[colour2 | _greenLookup[srcdata[3]]];
+
+					targ += _surface.pitch;
+				}
+			}
+
+			i++;
+			source += 4;
+			target += 4;
+			source_colour += 2;
+		}
+		source += 320 * 3;
+		target += _surface.pitch * 3;
+		source_colour += 160 * 3;
+	}
+}
+
+void FVFDecoder::convertFrame24(const byte *source, const byte *source_colour) {
 	byte *target = (byte *)_surface.getPixels();
 	unsigned int i = 0;
 	// colour is processed in 4x4 blocks
@@ -432,9 +827,9 @@ void FVFDecoder::decodeVideoFrame(uint16 *frame, unsigned int len) {
 				//uint16 colour1, colour2;
 				for (unsigned int j = 0; j < 4; j++) {
 					// 4 input pixels = 12 output bytes
-					byte *srcdata = source + (j * 320);
+					const byte *srcdata = source + (j * 320);
 
-					byte *src_col_ptr = source_colour;
+					const byte *src_col_ptr = source_colour;
 					if (j > 1) src_col_ptr += 320;
 
 					byte colour1, colour2;
@@ -478,11 +873,6 @@ void FVFDecoder::decodeVideoFrame(uint16 *frame, unsigned int len) {
 		target += 320 * 3 * 3; // 24bpp
 		source_colour += 160 * 3;
 	}
-
-	curr_status = 2;
-	if (flags & 0x4) {
-		curr_status = 3;
-	}
 }
 
 void FVFDecoder::decodeVideoFrameData(uint16 *frame, unsigned int len) {
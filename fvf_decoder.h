@@ -17,11 +17,14 @@
 #ifndef FVF_DECODER_H
 #define FVF_DECODER_H
 
+#include "common/array.h"
 #include "common/rational.h"
+#include "common/rect.h"
 
 #include "video/video_decoder.h"
 #include "image/codecs/codec.h"
 #include "audio/audiostream.h"
+#include "audio/timestamp.h"
 #include "audio/mixer.h"
 
 namespace Unity {
@@ -38,7 +41,20 @@ public:
 	bool isVideoLoaded() const { return _fileStream != 0; }
 
 	::Graphics::Surface *internalDecodeNextFrame();
-	::Graphics::PixelFormat getPixelFormat() const;
+	::Graphics::PixelFormat getPixelFormat() const { return _pixelFormat; }
+
+	// 8 (CLUT8), 16, 24 or 32bpp; must be called before loadStream
+	void setOutputPixelFormat(const ::Graphics::PixelFormat &format);
+
+	// continue from the given frame, starting from the closest key frame
+	// before it; frames in between are decoded without their audio
+	bool seekToFrame(uint32 frame);
+
+	// for decoding without playing: don't queue any audio
+	void setAudioEnabled(bool enabled) { _audioEnabled = enabled; }
+
+	// the parts of the surface changed by the last decoded frame
+	const Common::Array<Common::Rect> &getChangedRects() const { return _changedRects; }
 
 protected:
 	class FVFVideoTrack : public FixedRateVideoTrack {
@@ -53,6 +69,10 @@ protected:
 		const ::Graphics::Surface *decodeNextFrame() { return _parent->internalDecodeNextFrame(); }
 		::Graphics::PixelFormat getPixelFormat() const { return _parent->getPixelFormat(); }
 		int getFrameCount() const { return _parent->_frameCount; }
+		const byte *getPalette() const { _parent->_dirtyPalette = false; return _parent->_palette; }
+		bool hasDirtyPalette() const { return _parent->_dirtyPalette; }
+		bool isSeekable() const { return true; }
+		bool seek(const Audio::Timestamp &time);
 
 		FVFDecoder *_parent;
 	};
@@ -61,6 +81,9 @@ protected:
 	public:
 		FVFAudioTrack(FVFDecoder *parent) : AudioTrack(Audio::Mixer::kPlainSoundType), _parent(parent) { }
 
+		bool isSeekable() const { return true; }
+		bool seek(const Audio::Timestamp &time);
+
 	protected:
 		virtual Audio::AudioStream *getAudioStream() const { return _parent->_audioStream; }
 		FVFDecoder *_parent;
@@ -84,21 +107,73 @@ private:
 	Common::SeekableReadStream *_fileStream;
 
 	::Graphics::Surface _surface;
+	::Graphics::PixelFormat _pixelFormat;
+
+	// each component's bits in _pixelFormat, for 16/32bpp output;
+	// for 8bpp, each component's bits in a _colourMap index
+	uint32 _redLookup[256], _greenLookup[256], _blueLookup[256];
+
+	// 8bpp output: the header palette followed by the latest frame palette,
+	// and the nearest entry for each 12-bit colour
+	byte _palette[256 * 3];
+	bool _dirtyPalette;
+	byte _colourMap[4096];
+	void setFramePalette(const byte *data);
+	void updateColourMap(unsigned int first, unsigned int last);
+	// convert every block of the next frame, not just the changed ones
+	bool _convertAll;
 
 	byte palette_entry_count, header_pal_count;
 
 	void readNextBlock();
-	uint32 curr_block_remaining_frames, curr_block_remaining_size;
-
-	// generated lookup tables
-	uint32 block_id_to_offset[6000];
-	uint32 block_status_lookup[6000];
-	uint16 block_lookup[16000];
-	byte modify_lookup[32768];
-
-	// front/back buffers
-	byte real_front_buffer[64000], real_back_buffer[64000],
-		real_colour_front_buffer[32000], real_colour_back_buffer[32000];
+	uint32 curr_block_remaining_frames;
+
+	// The blocks seen so far: readNextBlock adds each one as it reaches it,
+	// and seekToFrame reads ahead through the block headers if it has to.
+	// (Reading the whole file up front would mean inflating all of it, for
+	// movies streamed from a zip.)
+	struct BlockIndexEntry {
+		uint32 offset;
+		uint32 firstFrame;
+		bool keyFrame; // the first frame has video with flag 0x1
+	};
+	Common::Array<BlockIndexEntry> _blockIndex;
+	uint32 _indexEnd; // offset of the first block not indexed yet
+	uint32 _indexFrames; // how many frames the indexed blocks have
+	uint32 _lastDataOffset;
+	bool _indexComplete;
+	void indexBlock(uint32 offset, const byte *header, const byte *frame);
+	void indexAhead(uint32 frame);
+
+	// set while seeking, so skipped frames don't queue their audio
+	bool _skipAudio;
+	bool _audioEnabled;
+
+	// the current block is read in one go, and frames are decoded from it
+	byte *_blockData;
+	uint32 _blockSize, _blockCapacity, _blockPos;
+
+	// audio chunks are copied into a ring of buffers which the queue
+	// doesn't own, so they can be reused once it has played them
+	enum { kAudioBufferCount = 16 };
+	byte *_audioBuffers[kAudioBufferCount];
+	uint32 _audioBufferSizes[kAudioBufferCount];
+	unsigned int _nextAudioBuffer;
+	void queueAudio(const byte *data, uint32 length);
+
+	// generated lookup tables; these only depend on the (fixed) frame
+	// size, so are shared by every decoder and generated once
+	static uint32 block_id_to_offset[6000];
+	static uint32 block_status_lookup[6000];
+	static uint16 block_lookup[16000];
+	static byte modify_lookup[32768];
+	static bool _tablesReady;
+	static void setupTables();
+
+	// front/back buffers, only allocated while a movie is loaded
+	byte *_frameBuffers;
+	byte *real_front_buffer, *real_back_buffer,
+		*real_colour_front_buffer, *real_colour_back_buffer;
 	byte *front_buffer, *back_buffer, *colour_front_buffer, *colour_back_buffer;
 
 	// decoder state (visibility)
@@ -107,9 +182,16 @@ private:
 	// decoder state (per-frame offset data)
 	int16 storage[256];
 
-	void setupTables();
+	// runs of changed blocks in each row of blocks, from block_status
+	Common::Array<Common::Rect> _changedRects;
+	void findChangedRects();
+
+	void resetDecoderState();
 	void decodeVideoFrame(uint16 *frame, unsigned int len);
 	void decodeVideoFrameData(uint16 *frame, unsigned int len);
+	template<typename PixelInt> void convertFrame(const byte *source, const byte *source_colour);
+	void convertFrame24(const byte *source, const byte *source_colour);
+	void convertFrame8(const byte *source, const byte *source_colour);
 
 	unsigned int GetOddPixelOffset(unsigned int in);
 };
@@ -16,9 +16,11 @@
 
 #include "graphics.h"
 #include "sprite_player.h"
+#include "common/config-manager.h"
 #include "common/system.h"
 #include "common/events.h"
 #include "common/textconsole.h"
+#include "common/util.h"
 #include "engines/util.h" // initGraphics
 #include "graphics/font.h"
 #include "graphics/surface.h"
@@ -55,21 +57,41 @@ static const byte sciMouseCursor[] = {
 };
 
 Graphics::Graphics(UnityEngine *_engine) : _vm(_engine) {
-	_basePalette = 0;
-	_palette = 0;
-	_background.data = 0;
+	_hasPalette = false;
+	_uploadedPaletteValid = false;
+	_paletteUploads = 0;
+	_paletteUploadRate = 0;
+	_paletteRateStart = 0;
+	_background = NULL;
+	_backgroundClock = 0;
+	_polygonOverlayEnabled = false;
+	_recording = false;
+	_checkComposite = false;
+	_scaledFrameFirst = 0;
+	_polygonOverlay.w = _polygonOverlay.h = 0;
+	_scaledFrameClock = 0;
 }
 
 Graphics::~Graphics() {
-	delete[] _basePalette;
-	delete[] _palette;
-
 	for (unsigned int i = 0; i < _cursors.size(); i++)
 		delete[] _cursors[i].data;
 	for (unsigned int i = 0; i < _waitCursors.size(); i++)
 		delete[] _waitCursors[i].data;
-	delete[] _background.data;
+	for (uint i = 0; i < _backgrounds.size(); i++) {
+		delete[] _backgrounds[i]->data;
+		delete _backgrounds[i];
+	}
+
+	for (uint i = 0; i < _scaledFrames.size(); i++)
+		delete[] _scaledFrames[i].data;
+
+	for (Common::HashMap<Common::String, MRGFile *>::iterator i = _mrgFiles.begin(); i != _mrgFiles.end(); i++)
+		delete i->_value;
 
+	if (_polygonOverlay.w)
+		_polygonOverlay.free();
+
+	clearTextRuns();
 	for (uint i = 0; i < _fonts.size(); i++)
 		delete _fonts[i];
 }
@@ -81,9 +103,7 @@ void Graphics::init() {
 }
 
 void Graphics::loadPalette() {
-	delete[] _basePalette;
 	// read the standard palette entries
-	_basePalette = new byte[128 * 3];
 	Common::SeekableReadStream *palStream = _vm->data.openFile("STANDARD.PAL");
 	for (uint16 i = 0; i < 128; i++) {
 		_basePalette[i * 3] = palStream->readByte();
@@ -93,6 +113,52 @@ void Graphics::loadPalette() {
 	delete palStream;
 }
 
+enum {
+	// unchanged runs shorter than this are uploaded anyway, to save calls
+	kPaletteRangeGap = 16
+};
+
+void Graphics::updatePalette(bool force) {
+	if (force || !_uploadedPaletteValid) {
+		_vm->_system->getPaletteManager()->setPalette(_palette, 0, 256);
+		_paletteUploads++;
+	} else {
+		uint i = 0;
+		while (i < 256) {
+			if (!memcmp(_uploadedPalette + i * 3, _palette + i * 3, 3)) {
+				i++;
+				continue;
+			}
+
+			// extend the range until a long enough unchanged run
+			uint start = i, end = i + 1, same = 0;
+			for (i = end; i < 256 && same < kPaletteRangeGap; i++) {
+				if (memcmp(_uploadedPalette + i * 3, _palette + i * 3, 3)) {
+					end = i + 1;
+					same = 0;
+				} else
+					same++;
+			}
+
+			_vm->_system->getPaletteManager()->setPalette(_palette + start * 3, start, end - start);
+			_paletteUploads++;
+		}
+	}
+
+	memcpy(_uploadedPalette, _palette, 256 * 3);
+	_uploadedPaletteValid = true;
+}
+
+uint Graphics::getPaletteUploadRate() {
+	uint32 now = _vm->_system->getMillis();
+	if (now - _paletteRateStart >= 1000) {
+		_paletteUploadRate = (_paletteUploads * 1000) / (now - _paletteRateStart);
+		_paletteUploads = 0;
+		_paletteRateStart = now;
+	}
+	return _paletteUploadRate;
+}
+
 void Graphics::loadCursors() {
 	for (unsigned int i = 0; i < _cursors.size(); i++)
 		delete[] _cursors[i].data;
@@ -146,12 +212,18 @@ void Graphics::setCursor(unsigned int id, bool wait) {
 	CursorMan.showMouse(true);
 }
 
+enum {
+	// drawString/wordWrapText results kept before the caches are flushed
+	kTextCacheSize = 128
+};
+
 class UnityFont : public ::Graphics::Font {
 protected:
 	uint32 _start, _end;
 	uint16 _size;
 	byte _glyphPitch, _glyphHeight;
 	byte *_data, *_widths;
+	byte _background;
 
 public:
 	UnityFont(Common::SeekableReadStream *fontStream) {
@@ -173,6 +245,7 @@ public:
 			_glyphPitch = 0;
 			_data = NULL;
 			_widths = NULL;
+			_background = 0;
 			return;
 		}
 
@@ -188,7 +261,31 @@ public:
 			fontStream->read(_data + (i * _size), _size);
 		}
 		// (TODO: sometimes files have exactly one more char on the end?)
+
+		findBackground();
 	}
+
+	// The colour glyph cells are filled with: whatever most of the space
+	// character is (or, without one, most of all the glyphs).
+	void findBackground() {
+		uint32 counts[256];
+		memset(counts, 0, sizeof(counts));
+		uint num_glyphs = _end - _start + 1;
+		if (_start <= ' ' && _end >= ' ') {
+			byte *data = _data + ((' ' - _start) * _size);
+			for (uint i = 0; i < _size; i++)
+				counts[data[i]]++;
+		} else {
+			for (uint i = 0; i < num_glyphs * _size; i++)
+				counts[_data[i]]++;
+		}
+
+		_background = 0;
+		for (uint i = 1; i < 256; i++)
+			if (counts[i] > counts[_background])
+				_background = i;
+	}
+	byte getBackground() const { return _background; }
 	virtual ~UnityFont() {
 		delete[] _data;
 		delete[] _widths;
@@ -214,7 +311,10 @@ public:
 		chr -= _start;
 		byte *data = _data + (chr * _size);
 		for (uint line = 0; line < _glyphHeight; line++) {
-			memcpy(dst->getBasePtr(x, y + line), data, _widths[chr]);
+			byte *out = (byte *)dst->getBasePtr(x, y + line);
+			for (uint i = 0; i < _widths[chr]; i++)
+				if (data[i] != _background)
+					out[i] = data[i];
 			data += _glyphPitch;
 		}
 	}
@@ -229,7 +329,9 @@ void Graphics::loadFonts() {
 		Common::String filename;
 		filename = Common::String::format("font%d.fon", num);
 		Common::SeekableReadStream *fontStream = _vm->data.openFile(filename.c_str());
-		_fonts.push_back(new UnityFont(fontStream));
+		UnityFont *font = new UnityFont(fontStream);
+		_fonts.push_back(font);
+		_fontBackgrounds.push_back(font->getBackground());
 		delete fontStream;
 	}
 }
@@ -242,14 +344,64 @@ uint Graphics::getStringWidth(const Common::String &text, uint font) const {
 	return _fonts[font]->getStringWidth(text);
 }
 
-void Graphics::drawString(uint x, uint y, const Common::String &text, uint font) const {
-	::Graphics::Surface *surf = _vm->_system->lockScreen();
-	_fonts[font]->drawString(surf, text, x, y, 9999, 0);
-	_vm->_system->unlockScreen();
+void Graphics::clearTextRuns() {
+	for (Common::HashMap<Common::String, ::Graphics::Surface>::iterator i = _textRuns.begin(); i != _textRuns.end(); i++)
+		i->_value.free();
+	_textRuns.clear();
+}
+
+const ::Graphics::Surface *Graphics::getTextRun(const Common::String &text, uint font) {
+	Common::String key = Common::String::format("%d:", font) + text;
+	if (_textRuns.contains(key))
+		return &_textRuns[key];
+
+	uint width = getStringWidth(text, font);
+	if (!width)
+		return NULL;
+
+	// (while recording, the cache is only flushed by beginFrame)
+	if (!_recording && _textRuns.size() >= kTextCacheSize)
+		clearTextRuns();
+
+	// render the whole string once, so later draws are a single blit
+	::Graphics::Surface &run = _textRuns[key];
+	run.create(width, getFontHeight(font), ::Graphics::PixelFormat::createFormatCLUT8());
+	memset(run.getPixels(), _fontBackgrounds[font], run.pitch * run.h);
+	_fonts[font]->drawString(&run, text, 0, 0, width, 0);
+	return &run;
+}
+
+void Graphics::drawString(uint x, uint y, const Common::String &text, uint font) {
+	const ::Graphics::Surface *run = getTextRun(text, font);
+	if (!run)
+		return;
+
+	blit((byte *)run->getPixels(), x, y, run->w, run->h, _fontBackgrounds[font]);
+}
+
+uint Graphics::wordWrapText(const Common::String &text, uint maxWidth, Common::Array<Common::String> &lines, uint font) {
+	Common::String key = Common::String::format("%d:%d:", font, maxWidth) + text;
+	if (!_wrappedText.contains(key)) {
+		if (_wrappedText.size() >= kTextCacheSize)
+			_wrappedText.clear();
+
+		WrappedText &wrapped = _wrappedText[key];
+		wrapped.width = _fonts[font]->wordWrapText(text, maxWidth, wrapped.lines);
+	}
+
+	const WrappedText &wrapped = _wrappedText[key];
+	for (uint i = 0; i < wrapped.lines.size(); i++)
+		lines.push_back(wrapped.lines[i]);
+	return wrapped.width;
 }
 
 void Graphics::loadMRG(Common::String filename, MRGFile *mrg) {
 	Common::SeekableReadStream *mrgStream = _vm->data.openFile(filename);
+	readMRG(mrgStream, mrg);
+	delete mrgStream;
+}
+
+void Graphics::readMRG(Common::SeekableReadStream *mrgStream, MRGFile *mrg) {
 	uint16 num_entries = mrgStream->readUint16LE();
 
 	Common::Array<uint32> offsets;
@@ -270,8 +422,16 @@ void Graphics::loadMRG(Common::String filename, MRGFile *mrg) {
 		mrg->widths.push_back(width);
 		mrg->data.push_back(pixels);
 	}
+}
+
+MRGFile &Graphics::getMRG(const Common::String &filename) {
+	if (!_mrgFiles.contains(filename)) {
+		MRGFile *mrg = new MRGFile;
+		loadMRG(filename, mrg);
+		_mrgFiles[filename] = mrg;
+	}
 
-	delete mrgStream;
+	return *_mrgFiles[filename];
 }
 
 void Graphics::drawMRG(MRGFile *mrg, unsigned int entry, unsigned int x, unsigned int y) {
@@ -280,62 +440,239 @@ void Graphics::drawMRG(MRGFile *mrg, unsigned int entry, unsigned int x, unsigne
 	blit(mrg->data[entry], x, y, mrg->widths[entry], mrg->heights[entry], COLOUR_BLANK);
 }
 
-void Graphics::setBackgroundImage(Common::String filename) {
-	delete[] _palette;
-	_palette = new byte[256 * 3];
+enum {
+	kBackgroundWidth = 640,
+	kBackgroundHeight = 480,
+
+	// how many decoded backgrounds (with palettes) to keep around
+	kBackgroundCacheSize = 4,
+
+	// how many bands the composite check draws the frame in
+	kCompositeCheckBands = 4
+};
+
+Graphics::BackgroundImage *Graphics::loadBackgroundImage(const Common::String &filename) {
+	for (uint i = 0; i < _backgrounds.size(); i++) {
+		if (_backgrounds[i]->filename == filename) {
+			_backgrounds[i]->lastUsed = ++_backgroundClock;
+			return _backgrounds[i];
+		}
+	}
 
+	BackgroundImage *image;
+	if (_backgrounds.size() < kBackgroundCacheSize) {
+		image = new BackgroundImage;
+		image->data = new byte[kBackgroundWidth * kBackgroundHeight];
+		_backgrounds.push_back(image);
+	} else {
+		// reuse the least recently used one
+		image = _backgrounds[0];
+		for (uint i = 1; i < _backgrounds.size(); i++)
+			if (_backgrounds[i]->lastUsed < image->lastUsed)
+				image = _backgrounds[i];
+	}
+	image->filename = filename;
+	image->lastUsed = ++_backgroundClock;
+
+	byte *palette = image->palette;
 	Common::SeekableReadStream *scrStream = _vm->data.openFile(filename);
 	for (uint16 i = 0; i < 128; i++) {
-		_palette[i * 3] = scrStream->readByte();
-		_palette[i * 3 + 1] = scrStream->readByte();
-		_palette[i * 3 + 2] = scrStream->readByte();
+		palette[i * 3] = scrStream->readByte();
+		palette[i * 3 + 1] = scrStream->readByte();
+		palette[i * 3 + 2] = scrStream->readByte();
 	}
-	memcpy(_palette + 128*3, _basePalette, 128*3);
+	memcpy(palette + 128*3, _basePalette, 128*3);
 
 	for (uint16 i = 0; i < 256; i++) {
 		for (byte j = 0; j < 3; j++) {
-			_palette[i * 3 + j] = _palette[i * 3 + j] << 2;
+			palette[i * 3 + j] = palette[i * 3 + j] << 2;
 		}
 	}
 
-	_vm->_system->getPaletteManager()->setPalette(_palette, 0, 256);
-
 	// some of the files seem to be 480 high, but just padded with black
-	_background.width = 640;
-	_background.height = 480;
-
-	delete[] _background.data;
-	_background.data = new byte[_background.width * _background.height];
-	scrStream->read(_background.data, _background.width * _background.height);
+	memset(image->data, 0, kBackgroundWidth * kBackgroundHeight);
+	scrStream->read(image->data, kBackgroundWidth * kBackgroundHeight);
 	delete scrStream;
+
+	return image;
+}
+
+void Graphics::setBackgroundImage(Common::String filename) {
+	_background = loadBackgroundImage(filename);
+	restoreBackgroundPalette();
+}
+
+// undo any palette changes (e.g. from sprites) since the background was set
+void Graphics::restoreBackgroundPalette() {
+	assert(_background);
+
+	memcpy(_palette, _background->palette, 256 * 3);
+	_hasPalette = true;
+	updatePalette();
 }
 
 void Graphics::drawBackgroundImage() {
-	assert(_background.data);
+	assert(_background);
+
+	DrawItem item;
+	item.data = _background->data;
+	item.x = item.y = 0;
+	item.width = kBackgroundWidth;
+	item.height = kBackgroundHeight;
+	item.scale = 256;
+	item.transparent = -1;
+	item.colour = 0;
+	item.owner = NULL;
+	addDrawItem(item);
+}
+
+void Graphics::beginFrame() {
+	// flush the text cache here, so nothing recorded this frame can go away
+	if (_textRuns.size() >= kTextCacheSize)
+		clearTextRuns();
 
-	_vm->_system->copyRectToScreen(_background.data, _background.width, 0, 0, _background.width, _background.height);
+	_frame.clear();
+	_recording = true;
 }
 
-// XXX: default transparent is a hack (see header file)
-void Graphics::blit(byte *data, int x, int y, unsigned int width, unsigned int height, byte transparent) {
-	// TODO: work with internal buffer and dirty-rectangling?
+void Graphics::endFrame() {
+	_recording = false;
+}
+
+// composite the frame recorded by beginFrame/endFrame, to the screen or the given surface
+void Graphics::renderFrame(::Graphics::Surface *target) {
+	assert(!_recording);
+
+	// settle the scaled frame cache first, so compositing only reads shared state
+	_scaledFrameFirst = _scaledFrameClock + 1;
+	_composite.resize(_frame.size());
+	for (unsigned int i = 0; i < _frame.size(); i++) {
+		_composite[i] = _frame[i];
+		resolveScaledFrame(_composite[i]);
+	}
+
+	if (target) {
+		compositeFrame(target, Common::Rect(target->w, target->h));
+		return;
+	}
+
+	::Graphics::Surface *surf = _vm->_system->lockScreen();
+	compositeFrame(surf, Common::Rect(surf->w, surf->h));
+	if (_checkComposite) {
+		_checkComposite = false;
+		checkComposite();
+	}
+	_vm->_system->unlockScreen();
+}
+
+// roughly how much memory the caches are holding
+uint32 Graphics::getCacheSize() const {
+	uint32 size = _backgrounds.size() * kBackgroundWidth * kBackgroundHeight;
+	for (unsigned int i = 0; i < _scaledFrames.size(); i++)
+		if (_scaledFrames[i].data)
+			size += _scaledFrames[i].width * _scaledFrames[i].height;
+	for (Common::HashMap<Common::String, ::Graphics::Surface>::const_iterator i = _textRuns.begin(); i != _textRuns.end(); i++)
+		size += i->_value.pitch * i->_value.h;
+	for (Common::HashMap<Common::String, MRGFile *>::const_iterator i = _mrgFiles.begin(); i != _mrgFiles.end(); i++)
+		for (unsigned int j = 0; j < i->_value->data.size(); j++)
+			size += i->_value->widths[j] * i->_value->heights[j];
+	size += _polygonOverlay.pitch * _polygonOverlay.h;
+	return size;
+}
+
+// draw the part of the resolved frame inside 'clip', every item in order
+void Graphics::compositeFrame(::Graphics::Surface *surf, const Common::Rect &clip) {
+	for (unsigned int i = 0; i < _composite.size(); i++)
+		drawItem(surf, _composite[i], clip);
+}
+
+// Clipping must not change the output: draw the frame as horizontal bands,
+// and compare that against a single pass.
+void Graphics::checkComposite() {
+	::Graphics::Surface single, banded;
+	single.create(kBackgroundWidth, kBackgroundHeight, ::Graphics::PixelFormat::createFormatCLUT8());
+	banded.create(kBackgroundWidth, kBackgroundHeight, ::Graphics::PixelFormat::createFormatCLUT8());
+	memset(single.getPixels(), 0, single.pitch * single.h);
+	memset(banded.getPixels(), 0, banded.pitch * banded.h);
+
+	const unsigned int bands = kCompositeCheckBands;
+	compositeFrame(&single, Common::Rect(single.w, single.h));
+	for (unsigned int band = 0; band < bands; band++) {
+		Common::Rect clip(0, (banded.h * band) / bands, banded.w, (banded.h * (band + 1)) / bands);
+		compositeFrame(&banded, clip);
+	}
+
+	unsigned int y = 0;
+	while (y < kBackgroundHeight && !memcmp(single.getBasePtr(0, y), banded.getBasePtr(0, y), kBackgroundWidth))
+		y++;
+	if (y < kBackgroundHeight)
+		warning("composite check: %d bands differ from a single pass at line %d (%d items)",
+			bands, y, _composite.size());
+	else
+		debug(1, "composite check: %d bands match a single pass (%d items)",
+			bands, _composite.size());
+
+	single.free();
+	banded.free();
+}
+
+void Graphics::addDrawItem(const DrawItem &item) {
+	if (_recording) {
+		_frame.push_back(item);
+		return;
+	}
+
+	DrawItem resolved = item;
+	_scaledFrameFirst = _scaledFrameClock + 1;
+	resolveScaledFrame(resolved);
 	::Graphics::Surface *surf = _vm->_system->lockScreen();
-	// XXX: this code hasn't had any thought
-	int startx = 0, starty = 0;
-	if (x < 0)
-		startx = -x;
-	if (y < 0)
-		starty = -y;
-	unsigned int usewidth = width, useheight = height;
-	if (x + (int)width > (int)surf->w)
-		usewidth = surf->w - x;
-	if (y + (int)height > (int)surf->h)
-		useheight = surf->h - y;
-	for (unsigned int xpos = startx; xpos < usewidth; xpos++) {
-		for (unsigned int ypos = starty; ypos < useheight; ypos++) {
-			byte pixel = data[xpos + ypos*width];
+	drawItem(surf, resolved, Common::Rect(surf->w, surf->h));
+	_vm->_system->unlockScreen();
+}
+
+// XXX: default transparent is a hack (see header file)
+void Graphics::blit(const byte *data, int x, int y, unsigned int width, unsigned int height, byte transparent) {
+	DrawItem item;
+	item.data = data;
+	item.x = x;
+	item.y = y;
+	item.width = width;
+	item.height = height;
+	item.scale = 256;
+	item.transparent = transparent;
+	item.colour = 0;
+	item.owner = NULL;
+	addDrawItem(item);
+}
+
+// clip (x, y, width, height) against clip (which must be inside the surface); false if nothing is left
+static bool clipTo(const Common::Rect &clip, int x, int y, unsigned int width, unsigned int height,
+	int &startx, int &starty, int &endx, int &endy) {
+	startx = MAX(clip.left - x, 0);
+	starty = MAX(clip.top - y, 0);
+	endx = MIN((int)width, clip.right - x);
+	endy = MIN((int)height, clip.bottom - y);
+	return startx < endx && starty < endy;
+}
+
+static void blitImage(::Graphics::Surface *surf, const Common::Rect &clip, const byte *data, int x, int y,
+	unsigned int width, unsigned int height, int transparent) {
+	int startx, starty, endx, endy;
+	if (!clipTo(clip, x, y, width, height, startx, starty, endx, endy))
+		return;
+
+	for (int ypos = starty; ypos < endy; ypos++) {
+		const byte *src = data + ypos * width + startx;
+		byte *dest = (byte *)surf->getBasePtr(x + startx, y + ypos);
+		if (transparent == -1) {
+			memcpy(dest, src, endx - startx);
+			continue;
+		}
+		for (int xpos = startx; xpos < endx; xpos++) {
+			byte pixel = *src++;
 			if (pixel != transparent)
-				*((byte *)surf->getBasePtr(x + (int)xpos, y + (int)ypos)) = pixel;
+				*dest = pixel;
+			dest++;
 		}
 	}
 
@@ -344,52 +681,156 @@ void Graphics::blit(byte *data, int x, int y, unsigned int width, unsigned int h
 	surf->drawLine(x, y + height, x + width, y + height, 1);
 	surf->drawLine(x, y, x, y + height, 1);
 	surf->drawLine(x + width, y, x + width, y + height, 1);*/
-
-	_vm->_system->unlockScreen();
 }
 
-// TODO: replace this with something that doesn't suck :)
-static void hackyImageScale(byte *src, unsigned int width, unsigned int height,
+// nearest-neighbour scale, stepping through the source in 16.16 fixed point
+static void scaleImage(const byte *src, unsigned int width, unsigned int height,
 	byte *dest, unsigned int destwidth, unsigned int destheight) {
-	for (unsigned int x = 0; x < destwidth; x++) {
-		for (unsigned int y = 0; y < destheight; y++) {
-			unsigned int srcpixel = ((y * height) / destheight) * width + (x * width) / destwidth;
-			dest[y * destwidth + x] = src[srcpixel];
+	if (!destwidth || !destheight)
+		return;
+
+	uint32 xstep = (width << 16) / destwidth;
+	uint32 ystep = (height << 16) / destheight;
+
+	uint32 srcy = 0;
+	for (unsigned int y = 0; y < destheight; y++, srcy += ystep) {
+		const byte *srcrow = src + (srcy >> 16) * width;
+		uint32 srcx = 0;
+		for (unsigned int x = 0; x < destwidth; x++, srcx += xstep)
+			*dest++ = srcrow[srcx >> 16];
+	}
+}
+
+// the same scale as scaleImage, but written straight to the surface with transparency
+static void blitImageScaled(::Graphics::Surface *surf, const Common::Rect &clip, const byte *data,
+	unsigned int width, unsigned int height, int x, int y, unsigned int destwidth, unsigned int destheight,
+	int transparent) {
+	if (!destwidth || !destheight)
+		return;
+
+	int startx, starty, endx, endy;
+	if (!clipTo(clip, x, y, destwidth, destheight, startx, starty, endx, endy))
+		return;
+
+	uint32 xstep = (width << 16) / destwidth;
+	uint32 ystep = (height << 16) / destheight;
+
+	uint32 srcy = starty * ystep;
+	for (int ypos = starty; ypos < endy; ypos++, srcy += ystep) {
+		const byte *srcrow = data + (srcy >> 16) * width;
+		byte *dest = (byte *)surf->getBasePtr(x + startx, y + ypos);
+		uint32 srcx = startx * xstep;
+		for (int xpos = startx; xpos < endx; xpos++, srcx += xstep) {
+			byte pixel = srcrow[srcx >> 16];
+			if (pixel != transparent)
+				*dest = pixel;
+			dest++;
 		}
 	}
 }
 
-void Graphics::drawSprite(SpritePlayer *sprite, int x, int y, unsigned int scale) {
+void Graphics::drawItem(::Graphics::Surface *surf, const DrawItem &item, const Common::Rect &clip) {
+	if (!item.data) {
+		Common::Rect r(item.x, item.y, item.x + item.width, item.y + item.height);
+		r.clip(clip);
+		if (!r.isEmpty())
+			surf->fillRect(r, item.colour);
+	} else if (item.scale < 256)
+		blitImageScaled(surf, clip, item.data, item.width, item.height, item.x, item.y,
+			(item.width * item.scale) / 256, (item.height * item.scale) / 256, item.transparent);
+	else
+		blitImage(surf, clip, item.data, item.x, item.y, item.width, item.height, item.transparent);
+}
+
+static const unsigned int kScaledFrameCacheSize = 24;
+
+// point a scaled item at a cached scaled copy of its frame, if there is one
+void Graphics::resolveScaledFrame(DrawItem &item) {
+	if (!item.data || item.scale >= 256)
+		return;
+
+	unsigned int destwidth = (item.width * item.scale) / 256;
+	unsigned int destheight = (item.height * item.scale) / 256;
+
+	_scaledFrameClock++;
+
+	for (unsigned int i = 0; i < _scaledFrames.size(); i++) {
+		ScaledFrame &frame = _scaledFrames[i];
+		if (frame.owner != item.owner || frame.source != item.data || frame.scale != item.scale)
+			continue;
+
+		frame.lastUsed = _scaledFrameClock;
+		if (!frame.data) {
+			// second time we've seen this frame at this scale, so keep a copy
+			frame.data = new byte[destwidth * destheight];
+			scaleImage(item.data, item.width, item.height, frame.data, destwidth, destheight);
+		}
+		item.data = frame.data;
+		item.width = frame.width;
+		item.height = frame.height;
+		item.scale = 256;
+		return;
+	}
+
+	// only remember it for now: most frames of a walk cycle are never repeated at the same scale
+	unsigned int slot = _scaledFrames.size();
+	if (slot == kScaledFrameCacheSize) {
+		// (never evict something already resolved for the frame being composited)
+		slot = (unsigned int)-1;
+		for (unsigned int i = 0; i < _scaledFrames.size(); i++) {
+			if (_scaledFrames[i].lastUsed >= _scaledFrameFirst)
+				continue;
+			if (slot == (unsigned int)-1 || _scaledFrames[i].lastUsed < _scaledFrames[slot].lastUsed)
+				slot = i;
+		}
+		if (slot == (unsigned int)-1)
+			return;
+		delete[] _scaledFrames[slot].data;
+	} else {
+		_scaledFrames.push_back(ScaledFrame());
+	}
+
+	ScaledFrame &frame = _scaledFrames[slot];
+	frame.owner = item.owner;
+	frame.source = item.data;
+	frame.scale = item.scale;
+	frame.width = destwidth;
+	frame.height = destheight;
+	frame.data = NULL;
+	frame.lastUsed = _scaledFrameClock;
+}
+
+void Graphics::forgetScaledFrames(SpritePlayer *sprite) {
+	for (unsigned int i = 0; i < _scaledFrames.size(); ) {
+		if (_scaledFrames[i].owner != sprite) {
+			i++;
+			continue;
+		}
+		delete[] _scaledFrames[i].data;
+		_scaledFrames.remove_at(i);
+	}
+}
+
+// returns the rectangle covered by the (non-speech) sprite frame
+Common::Rect Graphics::drawSprite(SpritePlayer *sprite, int x, int y, unsigned int scale) {
 	assert(sprite);
 	byte *data = sprite->getCurrentData();
 	unsigned int width = sprite->getCurrentWidth();
 	unsigned int height = sprite->getCurrentHeight();
-	unsigned int bufwidth = width, bufheight = height;
 
 	byte *newpal = sprite->getPalette();
 	if (newpal) {
 		// new palette; used for things like the intro animation
 		debug("new sprite-embedded palette");
 
-		delete[] _palette;
-		_palette = new byte[256 * 3];
-
 		for (uint16 i = 0; i < 256; i++) {
 			_palette[i * 3] = *(newpal++) * 4;
 			_palette[i * 3 + 1] = *(newpal++) * 4;
 			_palette[i * 3 + 2] = *(newpal++) * 4;
 		}
 
-		_vm->_system->getPaletteManager()->setPalette(_palette, 0, 256);
-	}
-
-	if (scale < 256) {
-		bufwidth = (width * scale) / 256;
-		bufheight = (height * scale) / 256;
-		// TODO: alloca probably isn't too portable
-		byte *tempbuf = (byte *)alloca(bufwidth * bufheight);
-		hackyImageScale(data, width, height, tempbuf, bufwidth, bufheight);
-		data = tempbuf;
+		_hasPalette = true;
+		updatePalette();
 	}
 
 	// XXX: what's the sane behaviour here?
@@ -402,28 +843,29 @@ void Graphics::drawSprite(SpritePlayer *sprite, int x, int y, unsigned int scale
 
 	//printf("target x %d, y %d, adjustx %d, adjusty %d\n", sprite->getXPos(), sprite->getYPos(),
 	//	sprite->getXAdjust(), sprite->getYAdjust());
-	blit(data,
-		(int)targetx - ((-sprite->getXAdjust() + (int)width/2)*(int)scale)/256,
-		(int)targety - ((-sprite->getYAdjust() + (int)height)*(int)scale)/256,
-		bufwidth,
-		bufheight);
+	DrawItem item;
+	item.data = data;
+	item.x = (int)targetx - ((-sprite->getXAdjust() + (int)width/2)*(int)scale)/256;
+	item.y = (int)targety - ((-sprite->getYAdjust() + (int)height)*(int)scale)/256;
+	item.width = width;
+	item.height = height;
+	item.scale = scale;
+	item.transparent = COLOUR_BLANK;
+	item.colour = 0;
+	item.owner = sprite;
+	addDrawItem(item);
+
+	Common::Rect bounds(item.x, item.y, item.x + width, item.y + height);
+	if (scale < 256) {
+		bounds.right = item.x + (width * scale) / 256;
+		bounds.bottom = item.y + (height * scale) / 256;
+	}
 
 	if (sprite->speaking()) {
 		// XXX: this doesn't work properly, SpritePlayer side probably needs work too
 		data = sprite->getSpeechData();
 		unsigned int m_width = sprite->getSpeechWidth();
 		unsigned int m_height = sprite->getSpeechHeight();
-		bufwidth = m_width;
-		bufheight = m_height;
-
-		if (scale < 256) {
-			bufwidth = (m_width * scale) / 256;
-			bufheight = (m_height * scale) / 256;
-			// TODO: alloca probably isn't too portable
-			byte *tempbuf = (byte *)alloca(bufwidth * bufheight);
-			hackyImageScale(data, m_width, m_height, tempbuf, bufwidth, bufheight);
-			data = tempbuf;
-		}
 
 		// XXX: what's the sane behaviour here?
 		targetx = x;
@@ -434,11 +876,12 @@ void Graphics::drawSprite(SpritePlayer *sprite, int x, int y, unsigned int scale
 		//printf("speech target x %d, y %d, adjustx %d, adjusty %d\n",
 		//	sprite->getSpeechXPos(), sprite->getSpeechYPos(),
 		//	sprite->getSpeechXAdjust(), sprite->getSpeechYAdjust());
-		blit(data,
-			(int)targetx - ((-sprite->getSpeechXAdjust() + (int)m_width/2)*(int)scale)/256,
-			(int)targety - ((-sprite->getSpeechYAdjust() + (int)m_height)*(int)scale)/256,
-			bufwidth,
-			bufheight);
+		item.data = data;
+		item.x = (int)targetx - ((-sprite->getSpeechXAdjust() + (int)m_width/2)*(int)scale)/256;
+		item.y = (int)targety - ((-sprite->getSpeechYAdjust() + (int)m_height)*(int)scale)/256;
+		item.width = m_width;
+		item.height = m_height;
+		addDrawItem(item);
 	}
 
 	// plot cross at (x, y) loc
@@ -449,11 +892,32 @@ void Graphics::drawSprite(SpritePlayer *sprite, int x, int y, unsigned int scale
 	if (targety != 0) *((byte *)surf->getBasePtr(targetx, targety-1)) = 254;
 	if (targety != 480-1) *((byte *)surf->getBasePtr(targetx, targety+1)) = 254;
 	_vm->_system->unlockScreen();*/
+
+	return bounds;
+}
+
+void Graphics::setPolygonOverlayEnabled(bool enabled) {
+	_polygonOverlayEnabled = enabled;
+	updatePolygonOverlay();
 }
 
-void Graphics::drawBackgroundPolys(Common::Array<ScreenPolygon> &polys) {
+// re-render the overlay (only while enabled) after the polygons change
+void Graphics::updatePolygonOverlay() {
+	if (!_polygonOverlayEnabled) {
+		if (_polygonOverlay.w) {
+			_polygonOverlay.free();
+			_polygonOverlay.w = _polygonOverlay.h = 0;
+		}
+		return;
+	}
+
+	if (!_polygonOverlay.w)
+		_polygonOverlay.create(kBackgroundWidth, kBackgroundHeight, ::Graphics::PixelFormat::createFormatCLUT8());
+	memset(_polygonOverlay.getPixels(), COLOUR_BLANK, _polygonOverlay.pitch * _polygonOverlay.h);
+
+	const Common::Array<ScreenPolygon> &polys = _vm->data._currentScreen.polygons;
 	for (unsigned int i = 0; i < polys.size(); i++) {
-		ScreenPolygon &poly = polys[i];
+		const ScreenPolygon &poly = polys[i];
 		// something == 0: not walkable by default? (i.e. script-enabled)
 		// something == 3: ??
 		// something == 4: seems to usually cover almost the whole screen..
@@ -465,39 +929,93 @@ void Graphics::drawBackgroundPolys(Common::Array<ScreenPolygon> &polys) {
 		else if (poly.type == 3)
 			colour = 224; // grayish
 		for (unsigned int j = 0; j < poly.triangles.size(); j++) {
-			Common::Array<Common::Point> points;
-			points.push_back(poly.triangles[j].points[0]);
-			points.push_back(poly.triangles[j].points[1]);
-			points.push_back(poly.triangles[j].points[2]);
-			renderPolygonEdge(points, colour);
+			const Common::Point *points = poly.triangles[j].points;
+			for (unsigned int k = 0; k < 3; k++) {
+				const Common::Point &next = points[(k + 1) % 3];
+				_polygonOverlay.drawLine(points[k].x, points[k].y, next.x, next.y, colour);
+			}
 		}
 	}
 }
 
-void Graphics::renderPolygonEdge(Common::Array<Common::Point> &points, byte colour) {
-	::Graphics::Surface *surf = _vm->_system->lockScreen();
-	for (unsigned int i = 0; i < points.size(); i++) {
-		if (i + 1 < points.size())
-			surf->drawLine(points[i].x, points[i].y, points[i + 1].x, points[i + 1].y, colour);
-		else
-			surf->drawLine(points[i].x, points[i].y, points[0].x, points[0].y, colour);
-	}
-	_vm->_system->unlockScreen();
+void Graphics::drawPolygonOverlay() {
+	if (!_polygonOverlayEnabled)
+		return;
+
+	blit((byte *)_polygonOverlay.getPixels(), 0, 0, _polygonOverlay.w, _polygonOverlay.h, COLOUR_BLANK);
 }
 
 void Graphics::fillRect(byte colour, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2) {
-	::Graphics::Surface *surf = _vm->_system->lockScreen();
-	Common::Rect r(x1, y1, x2, y2);
-	surf->fillRect(r, colour);
-	_vm->_system->unlockScreen();
+	DrawItem item;
+	item.data = NULL;
+	item.x = x1;
+	item.y = y1;
+	item.width = x2 - x1;
+	item.height = y2 - y1;
+	item.scale = 256;
+	item.transparent = -1;
+	item.colour = colour;
+	item.owner = NULL;
+	addDrawItem(item);
+}
+
+enum {
+	// the most movie frames we'll drop in a row before showing one anyway
+	kMaxDroppedFrames = 15,
+
+	// paletted movies leave this entry black, for the borders
+	kMovieBorderColour = 255
+};
+
+// the first high colour format the backend offers, which it can show
+// without converting; FVFs can be decoded straight into any of them
+static ::Graphics::PixelFormat chooseMovieFormat(const ::Graphics::PixelFormat &fallback) {
+	Common::List< ::Graphics::PixelFormat> formats = g_system->getSupportedFormats();
+	for (Common::List< ::Graphics::PixelFormat>::iterator i = formats.begin(); i != formats.end(); i++) {
+		if (i->bytesPerPixel == 2 || i->bytesPerPixel == 4)
+			return *i;
+	}
+	return fallback;
+}
+
+// copy part of a movie frame to the screen; if we have the (locked)
+// screen, it's our paletted mode, so the pixels are doubled as we go
+static void presentMovieRect(::Graphics::Surface *screen, const ::Graphics::Surface *frame,
+	const Common::Rect &r, unsigned int movieY) {
+	if (!screen) {
+		g_system->copyRectToScreen(frame->getBasePtr(r.left, r.top), frame->pitch,
+			r.left, r.top, r.width(), r.height());
+		return;
+	}
+
+	for (int y = r.top; y < r.bottom; y++) {
+		const byte *src = (const byte *)frame->getBasePtr(r.left, y);
+		byte *dest = (byte *)screen->getBasePtr(r.left * 2, movieY + y * 2);
+		for (int x = 0; x < r.width(); x++)
+			dest[x * 2] = dest[x * 2 + 1] = src[x];
+		memcpy(dest + screen->pitch, dest, r.width() * 2);
+	}
 }
 
 void Graphics::playMovie(Common::String filename) {
 	Common::SeekableReadStream *intro_movie;
 	::Video::VideoDecoder *videoDecoder;
+	FVFDecoder *fvfDecoder = NULL;
+	// FVFs play in true colour, which means a mode change. Setting the
+	// 'paletted_movies' config key plays them in our own 640x480 paletted
+	// mode instead, with no mode change, but that's experimental: the 6-bit
+	// palette and the nearest-colour mapping (see FVFDecoder::convertFrame8)
+	// haven't been checked against the original, so it isn't the default.
+	bool paletted = false;
 	if (SearchMan.hasFile(filename)) {
 		intro_movie = _vm->data.openFile(filename);
-		videoDecoder = new FVFDecoder(g_system->getMixer());
+		fvfDecoder = new FVFDecoder(g_system->getMixer());
+		paletted = ConfMan.hasKey("paletted_movies") && ConfMan.getBool("paletted_movies");
+		if (paletted)
+			fvfDecoder->setOutputPixelFormat(::Graphics::PixelFormat::createFormatCLUT8());
+		else
+			fvfDecoder->setOutputPixelFormat(chooseMovieFormat(fvfDecoder->getPixelFormat()));
+		videoDecoder = fvfDecoder;
 	} else {
 		assert(filename.size() > 3);
 		filename = Common::String(filename.c_str(), filename.size() - 3) + "mov";
@@ -515,26 +1033,78 @@ void Graphics::playMovie(Common::String filename) {
 
 	bool skipVideo = false;
 
-	::Graphics::PixelFormat format = videoDecoder->getPixelFormat();
 	unsigned int vidwidth = videoDecoder->getWidth();
 	unsigned int vidheight = videoDecoder->getHeight();
-	unsigned int vidbpp = format.bytesPerPixel;
 
-	initGraphics(vidwidth, vidheight, false, &format);
-	assert(format.bytesPerPixel != 1);
+	// where the top of the (doubled) movie goes in paletted mode
+	unsigned int movieY = 0;
+	if (paletted) {
+		assert(vidwidth * 2 <= 640 && vidheight * 2 <= 480);
+		movieY = (480 - vidheight * 2) / 2;
+		g_system->fillScreen(kMovieBorderColour);
+	} else {
+		::Graphics::PixelFormat format = videoDecoder->getPixelFormat();
+		initGraphics(vidwidth, vidheight, false, &format);
+		assert(format.bytesPerPixel != 1);
+	}
 	g_system->showMouse(false);
 
 	videoDecoder->start();
 
+	// the screen has nothing of the movie on it yet
+	bool uploadAll = true;
+	unsigned int droppedFrames = 0;
+
 	while (!g_engine->shouldQuit() && !videoDecoder->endOfVideo() && !skipVideo) {
 		if (videoDecoder->needsUpdate()) {
 			const ::Graphics::Surface *frame = videoDecoder->decodeNextFrame();
+
+			// If the next frame is already due too, we've fallen behind, so
+			// don't bother showing this one. Every frame still has to be
+			// decoded (they depend on each other, and carry the audio).
+			unsigned int dropped = 0;
+			while (videoDecoder->needsUpdate() && !videoDecoder->endOfVideo() && dropped < kMaxDroppedFrames) {
+				const ::Graphics::Surface *next = videoDecoder->decodeNextFrame();
+				if (!next)
+					continue;
+				if (frame)
+					dropped++;
+				frame = next;
+			}
+			if (dropped) {
+				droppedFrames += dropped;
+				// the changed blocks of the dropped frames never reached the screen
+				uploadAll = true;
+			}
+
+			bool changed = false;
+			if (paletted && videoDecoder->hasDirtyPalette()) {
+				g_system->getPaletteManager()->setPalette(videoDecoder->getPalette(), 0, 256);
+				changed = true;
+			}
+
 			if (frame) {
-				g_system->copyRectToScreen((byte *)frame->getPixels(), vidwidth*vidbpp,
-					0, 0, vidwidth, vidheight);
+				::Graphics::Surface *screen = paletted ? g_system->lockScreen() : NULL;
+
+				if (uploadAll || !fvfDecoder) {
+					presentMovieRect(screen, frame, Common::Rect(vidwidth, vidheight), movieY);
+					uploadAll = false;
+					changed = true;
+				} else {
+					// only upload the blocks the decoder actually changed
+					const Common::Array<Common::Rect> &rects = fvfDecoder->getChangedRects();
+					for (unsigned int i = 0; i < rects.size(); i++)
+						presentMovieRect(screen, frame, rects[i], movieY);
+					if (!rects.empty())
+						changed = true;
+				}
+
+				if (screen)
+					g_system->unlockScreen();
+			}
 
+			if (changed)
 				g_system->updateScreen();
-			}
 		}
 
 		Common::Event event;
@@ -545,14 +1115,18 @@ void Graphics::playMovie(Common::String filename) {
 		}
 
 		if (!videoDecoder->needsUpdate())
-			g_system->delayMillis(10);
+			g_system->delayMillis(MIN<uint32>(10, videoDecoder->getTimeToNextFrame()));
 	}
 
-	initGraphics(640, 480, true);
+	debug(1, "movie %s: dropped %d of %d frames", filename.c_str(), droppedFrames, videoDecoder->getCurFrame() + 1);
+
+	if (!paletted)
+		initGraphics(640, 480, true);
 	g_system->showMouse(true);
-	if (_palette) {
-		_vm->_system->getPaletteManager()->setPalette(_palette, 0, 256);
-	}
+	// the movie replaced the backend palette (or the mode switch lost it)
+	_uploadedPaletteValid = false;
+	if (_hasPalette)
+		updatePalette(true);
 
 	delete videoDecoder;
 }
@@ -21,6 +21,8 @@
 #include "sprite_player.h"
 
 #include "common/rect.h"
+#include "common/hashmap.h"
+#include "graphics/surface.h"
 
 namespace Graphics {
 	class Font;
@@ -36,6 +38,18 @@ struct Image {
 	byte *data;
 };
 
+// something to be composited, as recorded between beginFrame and endFrame
+struct DrawItem {
+	const byte *data; // NULL for a solid fill
+	int x, y;
+	unsigned int width, height;
+	unsigned int scale; // 256 is unscaled
+	int transparent; // -1 if opaque
+	byte colour; // for fills
+	SpritePlayer *owner; // the sprite this frame belongs to, if any
+};
+typedef Common::Array<DrawItem> DrawList;
+
 struct MRGFile {
 	Common::Array<uint16> widths, heights;
 	Common::Array<byte *> data;
@@ -55,38 +69,121 @@ public:
 
 	void setCursor(unsigned int id, bool wait);
 	void setBackgroundImage(Common::String filename);
+	void restoreBackgroundPalette();
+
+	uint getPaletteUploadRate();
 
 	void loadMRG(Common::String filename, MRGFile *mrg);
+	void readMRG(Common::SeekableReadStream *mrgStream, MRGFile *mrg);
+	MRGFile &getMRG(const Common::String &filename);
+
+	void beginFrame();
+	void endFrame();
+	const DrawList &getFrame() const { return _frame; }
+	void renderFrame(::Graphics::Surface *target = NULL);
+	uint32 getCacheSize() const;
+
+	void requestCompositeCheck() { _checkComposite = true; }
 
 	::Graphics::Font *getFont(unsigned int id) const;
-	void drawString(uint x, uint y, const Common::String &text, uint font) const;
+	void drawString(uint x, uint y, const Common::String &text, uint font);
 	uint getFontHeight(uint font) const;
 	uint getStringWidth(const Common::String &text, uint font) const;
+	uint wordWrapText(const Common::String &text, uint maxWidth, Common::Array<Common::String> &lines, uint font);
 
 	void drawMRG(MRGFile *mrg, unsigned int entry, unsigned int x, unsigned int y);
 	void drawBackgroundImage();
-	void drawSprite(SpritePlayer *sprite, int x, int y, unsigned int scale = 256);
-	void drawBackgroundPolys(Common::Array<struct ScreenPolygon> &polys);
-	void renderPolygonEdge(Common::Array<Common::Point> &points, byte colour);
+	Common::Rect drawSprite(SpritePlayer *sprite, int x, int y, unsigned int scale = 256);
+
+	// debug overlay of the current screen's polygons
+	void setPolygonOverlayEnabled(bool enabled);
+	bool isPolygonOverlayEnabled() const { return _polygonOverlayEnabled; }
+	void updatePolygonOverlay();
+	void drawPolygonOverlay();
 
 	void fillRect(byte colour, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2);
 
+	void forgetScaledFrames(SpritePlayer *sprite);
+
 	void playMovie(Common::String filename);
 
 protected:
 	void loadPalette();
+	void updatePalette(bool force = false);
 	void loadCursors();
 	void loadFonts();
 
-	void blit(byte *data, int x, int y, unsigned int width, unsigned int height, byte transparent = COLOUR_BLANK);
+	void blit(const byte *data, int x, int y, unsigned int width, unsigned int height, byte transparent = COLOUR_BLANK);
+	void addDrawItem(const DrawItem &item);
+	void drawItem(::Graphics::Surface *surf, const DrawItem &item, const Common::Rect &clip);
+	void resolveScaledFrame(DrawItem &item);
+	void compositeFrame(::Graphics::Surface *surf, const Common::Rect &clip);
+	void checkComposite();
+
+	// the frame being recorded (or last recorded); drawing is immediate outside beginFrame/endFrame
+	DrawList _frame;
+	bool _recording;
+
+	// _frame with scaled frames resolved, as handed to the compositor
+	DrawList _composite;
+	bool _checkComposite;
+
+	// loaded by getMRG, kept until shutdown
+	Common::HashMap<Common::String, MRGFile *> _mrgFiles;
+
+	// scaled copies of recently-drawn sprite frames, keyed by (frame, scale)
+	struct ScaledFrame {
+		SpritePlayer *owner;
+		const byte *source;
+		unsigned int scale;
+		unsigned int width, height;
+		byte *data; // NULL until the frame has been drawn at this scale twice
+		uint32 lastUsed;
+	};
+	Common::Array<ScaledFrame> _scaledFrames;
+	uint32 _scaledFrameClock;
+	uint32 _scaledFrameFirst; // first clock value of the frame being resolved
+
+	bool _polygonOverlayEnabled;
+	::Graphics::Surface _polygonOverlay; // COLOUR_BLANK where nothing is drawn
+
+	// strings rendered by drawString, keyed by font and text
+	Common::HashMap<Common::String, ::Graphics::Surface> _textRuns;
+	const ::Graphics::Surface *getTextRun(const Common::String &text, uint font);
+	void clearTextRuns();
+
+	// wordWrapText results, keyed by font, width and text
+	struct WrappedText {
+		Common::Array<Common::String> lines;
+		uint width;
+	};
+	Common::HashMap<Common::String, WrappedText> _wrappedText;
 
 	UnityEngine *_vm;
-	byte *_basePalette, *_palette;
-	Image _background;
+	byte _basePalette[128 * 3];
+	byte _palette[256 * 3];
+	bool _hasPalette;
+
+	// what the backend currently has, so only changed entries are uploaded
+	byte _uploadedPalette[256 * 3];
+	bool _uploadedPaletteValid;
+	uint32 _paletteUploads, _paletteUploadRate, _paletteRateStart;
+	// recently-used decoded backgrounds, with their palettes
+	struct BackgroundImage {
+		Common::String filename;
+		byte palette[256 * 3];
+		byte *data;
+		uint32 lastUsed;
+	};
+	Common::Array<BackgroundImage *> _backgrounds;
+	BackgroundImage *_background;
+	uint32 _backgroundClock;
+	BackgroundImage *loadBackgroundImage(const Common::String &filename);
 	Common::Array<Image> _cursors;
 	Common::Array<Image> _waitCursors;
 
 	Common::Array< ::Graphics::Font *> _fonts;
+	Common::Array<byte> _fontBackgrounds; // the colour of empty glyph pixels
 };
 
 }
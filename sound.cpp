@@ -16,103 +16,327 @@
 
 #include "sound.h"
 #include "common/system.h"
-#include "common/memstream.h"
-#include "common/queue.h"
+#include "common/util.h"
 #include "audio/audiostream.h"
 #include "audio/decoders/adpcm_intern.h"
 
 namespace Unity {
 
+enum {
+	// how much compressed input to read from the stream at a time
+	kADPCMChunkSize = 2048,
+
+	// sound effects this small (compressed) are decoded once and kept
+	kSfxCacheMaxClip = 32 * 1024,
+	// the most decoded sound effect data (in bytes) to keep
+	kSfxCacheSize = 2 * 1024 * 1024,
+
+	// how many other pieces of music to have ready to play
+	kMusicPrefetchCount = 3,
+	// how many upcoming lines of speech to have ready to play
+	kSpeechPrefetchCount = 6,
+	// and how much of each to decode ahead of time (~0.4s of stereo music,
+	// ~0.7s of speech)
+	kPrefetchSamples = 16384
+};
+
 class Unity_ADPCMStream : public ::Audio::Ima_ADPCMStream {
 protected:
 	uint32 _loopPoint;
 	uint32 _currPos;
 	::Audio::ADPCMStream::ADPCMStatus _loopStatus;
-	Common::Queue<int16> _samplesBuffer;
+
+	// input read ahead from _stream; _currPos is where we are in it
+	byte _inBuffer[kADPCMChunkSize];
+	uint32 _inPos, _inSize;
+	bool refill();
+
+	// samples decoded but not yet returned (each byte pair makes 4)
+	int16 _leftover[4];
+	unsigned int _leftoverPos, _leftoverCount;
+
+	inline void decodePair(int16 *block);
 
 public:
 	Unity_ADPCMStream(Common::SeekableReadStream *stream, DisposeAfterUse::Flag disposeAfterUse, uint32 size, int rate, int channels, uint32 loopPoint = 0)
-		: Ima_ADPCMStream(stream, disposeAfterUse, size, rate, channels, 0), _loopPoint(loopPoint), _currPos(0) {
+		: Ima_ADPCMStream(stream, disposeAfterUse, size, rate, channels, 0), _loopPoint(loopPoint), _currPos(0),
+		_inPos(0), _inSize(0), _leftoverPos(0), _leftoverCount(0) {
 		memset(&_loopStatus, 0, sizeof(_loopStatus));
 	}
 
 	virtual bool endOfData() const;
 	virtual int readBuffer(int16 *buffer, const int numSamples);
 	virtual bool rewind();
+	void restart();
 };
 
 bool Unity_ADPCMStream::endOfData() const {
-	return _samplesBuffer.empty() && ADPCMStream::endOfData();
+	return !_leftoverCount && _inPos >= _inSize && ADPCMStream::endOfData();
 }
 
-int Unity_ADPCMStream::readBuffer(int16 *buffer, const int numSamples) {
+// make sure there's at least one byte pair buffered, if there's any input left
+bool Unity_ADPCMStream::refill() {
+	// keep any odd byte left over
+	uint32 remaining = _inSize - _inPos;
+	if (remaining)
+		_inBuffer[0] = _inBuffer[_inPos];
+	_inPos = 0;
+	_inSize = remaining;
+
+	if (!ADPCMStream::endOfData()) {
+		uint32 wanted = MIN<uint32>(kADPCMChunkSize - _inSize, _endpos - _stream->pos());
+		_inSize += _stream->read(_inBuffer + _inSize, wanted);
+	}
+
+	// a trailing odd byte is decoded with a zero after it (readByte past the end)
+	if (_inSize == 1 && ADPCMStream::endOfData())
+		_inBuffer[_inSize++] = 0;
+
+	return _inSize >= 2;
+}
+
+void Unity_ADPCMStream::decodePair(int16 *block) {
 	bool stereo = _channels == 2;
 
+	byte data = _inBuffer[_inPos++];
+	if (_currPos == _loopPoint)
+		memcpy(&_loopStatus.ima_ch[0], &_status.ima_ch[0], sizeof(_status.ima_ch[0]));
+	block[0] = decodeIMA(data & 0x0f);
+	block[stereo ? 2 : 1] = decodeIMA((data >> 4) & 0x0f);
+
+	data = _inBuffer[_inPos++];
+	if (_currPos + (stereo ? 0 : 2) == _loopPoint)
+		memcpy(&_loopStatus.ima_ch[stereo ? 1 : 0], &_status.ima_ch[stereo ? 1 : 0], sizeof(_status.ima_ch[0]));
+	block[stereo ? 1 : 2] = decodeIMA(data & 0x0f, stereo ? 1 : 0);
+	block[3] = decodeIMA((data >> 4) & 0x0f, stereo ? 1 : 0);
+
+	_currPos += 2;
+}
+
+int Unity_ADPCMStream::readBuffer(int16 *buffer, const int numSamples) {
 	int samples = 0;
 
 	// First, use anything left over from last time.
 	int16 *target = buffer;
-	while (!_samplesBuffer.empty() && samples < numSamples) {
-		*(target++) = _samplesBuffer.pop();
+	while (_leftoverCount && samples < numSamples) {
+		*(target++) = _leftover[_leftoverPos++];
+		_leftoverCount--;
 		samples++;
 	}
 
-	for (; samples < numSamples && !_stream->eos() && _stream->pos() < _endpos; samples += 4) {
-		byte data;
-		int16 block[4];
-
-		data = _stream->readByte();
-		if (_currPos == _loopPoint)
-			memcpy(&_loopStatus.ima_ch[0], &_status.ima_ch[0], sizeof(_status.ima_ch[0]));
-		block[0] = decodeIMA(data & 0x0f);
-		block[stereo ? 2 : 1] = decodeIMA((data >> 4) & 0x0f);
-
-		data = _stream->readByte();
-		if (_currPos + (stereo ? 0 : 2) == _loopPoint)
-			memcpy(&_loopStatus.ima_ch[stereo ? 1 : 0], &_status.ima_ch[stereo ? 1 : 0], sizeof(_status.ima_ch[0]));
-		block[stereo ? 1 : 2] = decodeIMA(data & 0x0f, stereo ? 1 : 0);
-		block[3] = decodeIMA((data >> 4) & 0x0f, stereo ? 1 : 0);
-
-		// Put the result in the output buffer, storing anything left.
-		for (int i = 0; i < 4; i++) {
-			if (samples + i < numSamples) {
-				*(target++) = block[i];
-			} else {
-				_samplesBuffer.push(block[i]);
-			}
+	while (samples < numSamples) {
+		if (_inSize - _inPos < 2 && !refill())
+			break;
+
+		// whole byte pairs straight into the output
+		while (samples + 4 <= numSamples && _inSize - _inPos >= 2) {
+			decodePair(target);
+			target += 4;
+			samples += 4;
 		}
 
-		_currPos += 2;
+		// a final pair which doesn't fit; keep the rest for next time
+		if (samples < numSamples && samples + 4 > numSamples && _inSize - _inPos >= 2) {
+			decodePair(_leftover);
+			_leftoverPos = 0;
+			_leftoverCount = 4;
+			while (samples < numSamples) {
+				*(target++) = _leftover[_leftoverPos++];
+				_leftoverCount--;
+				samples++;
+			}
+		}
 	}
 
-	if (samples > numSamples)
-		return numSamples;
 	return samples;
 }
 
 bool Unity_ADPCMStream::rewind() {
-	if (_stream->pos() < _startpos + (int)_loopPoint)
+	if (_currPos < _loopPoint)
 		return true;
 	memcpy(&_status, &_loopStatus, sizeof(_status));
 	_stream->seek(_startpos + _loopPoint);
 	_currPos = _loopPoint;
+	_inPos = _inSize = 0;
 	return true;
 }
 
+// go back to the very start, forgetting everything (the stream underneath
+// may have new data in it)
+void Unity_ADPCMStream::restart() {
+	memset(&_status, 0, sizeof(_status));
+	memset(&_loopStatus, 0, sizeof(_loopStatus));
+	_stream->seek(_startpos);
+	_currPos = 0;
+	_inPos = _inSize = 0;
+	_leftoverCount = 0;
+}
+
+// A stream with its first samples already decoded, so that it can start
+// playing without waiting on the disk.
+class PrefetchedAudioStream : public ::Audio::RewindableAudioStream {
+protected:
+	::Audio::RewindableAudioStream *_stream;
+	int16 *_head;
+	int _headSamples, _headPos;
+
+public:
+	PrefetchedAudioStream(::Audio::RewindableAudioStream *stream) : _stream(stream), _headPos(0) {
+		_head = new int16[kPrefetchSamples];
+		_headSamples = _stream->readBuffer(_head, kPrefetchSamples);
+	}
+	~PrefetchedAudioStream() {
+		delete[] _head;
+		delete _stream;
+	}
+
+	int readBuffer(int16 *buffer, const int numSamples) {
+		int samples = MIN(numSamples, _headSamples - _headPos);
+		memcpy(buffer, _head + _headPos, samples * 2);
+		_headPos += samples;
+		if (samples < numSamples)
+			samples += _stream->readBuffer(buffer + samples, numSamples - samples);
+		return samples;
+	}
+	bool isStereo() const { return _stream->isStereo(); }
+	int getRate() const { return _stream->getRate(); }
+	bool endOfData() const { return _headPos == _headSamples && _stream->endOfData(); }
+	// (the underlying stream rewinds to its loop point, past the prefetched part)
+	bool rewind() {
+		_headPos = _headSamples;
+		return _stream->rewind();
+	}
+};
+
+// A memory stream which can be pointed at different data, for SfxVoiceStream.
+class SfxVoiceInput : public Common::SeekableReadStream {
+protected:
+	const byte *_data;
+	uint32 _size, _pos;
+	bool _eos;
+
+public:
+	SfxVoiceInput() : _data(NULL), _size(0), _pos(0), _eos(false) { }
+
+	void reset(const byte *data, uint32 size) {
+		_data = data;
+		_size = size;
+		_pos = 0;
+		_eos = false;
+	}
+
+	uint32 read(void *dataPtr, uint32 dataSize) {
+		if (dataSize > _size - _pos) {
+			dataSize = _size - _pos;
+			_eos = true;
+		}
+		memcpy(dataPtr, _data + _pos, dataSize);
+		_pos += dataSize;
+		return dataSize;
+	}
+	bool eos() const { return _eos; }
+	int32 pos() const { return _pos; }
+	int32 size() const { return _size; }
+	bool seek(int32 offset, int whence = SEEK_SET) {
+		if (whence == SEEK_CUR)
+			offset += _pos;
+		else if (whence == SEEK_END)
+			offset += _size;
+		if (offset < 0 || (uint32)offset > _size)
+			return false;
+		_pos = offset;
+		_eos = false;
+		return true;
+	}
+};
+
+// The stream belonging to a sound effect voice. It's made once and reused
+// for each sound the voice plays, either decoding ADPCM (for sprites) or
+// copying from the sfx cache, so starting a sound doesn't allocate.
+class SfxVoiceStream : public ::Audio::AudioStream {
+protected:
+	SfxVoiceInput *_input;
+	Unity_ADPCMStream *_decoder;
+	const int16 *_samples; // NULL if decoding
+	uint32 _sampleCount, _samplePos;
+
+public:
+	SfxVoiceStream() : _samples(NULL), _sampleCount(0), _samplePos(0) {
+		_input = new SfxVoiceInput();
+		// (the input says where the data ends, so the decoder doesn't need to)
+		_decoder = new Unity_ADPCMStream(_input, DisposeAfterUse::YES, 0x7fffffff, 22050, 1);
+	}
+	~SfxVoiceStream() {
+		delete _decoder;
+	}
+
+	// (only while the mixer isn't playing this stream)
+	void playADPCM(const byte *data, uint32 length) {
+		_samples = NULL;
+		_input->reset(data, length);
+		_decoder->restart();
+	}
+	void playSamples(const int16 *samples, uint32 count) {
+		_samples = samples;
+		_sampleCount = count;
+		_samplePos = 0;
+	}
+
+	int readBuffer(int16 *buffer, const int numSamples) {
+		if (!_samples)
+			return _decoder->readBuffer(buffer, numSamples);
+		uint32 samples = MIN<uint32>(numSamples, _sampleCount - _samplePos);
+		memcpy(buffer, _samples + _samplePos, samples * 2);
+		_samplePos += samples;
+		return samples;
+	}
+	bool isStereo() const { return false; }
+	int getRate() const { return 22050; }
+	bool endOfData() const { return _samples ? _samplePos == _sampleCount : _decoder->endOfData(); }
+};
+
+Audio::RewindableAudioStream *makeUnityADPCMStream(Common::SeekableReadStream *stream,
+	DisposeAfterUse::Flag disposeAfterUse, uint32 size, int channels, uint32 loopPoint) {
+	return new Unity_ADPCMStream(stream, disposeAfterUse, size, 22050, channels, loopPoint);
+}
+
 Sound::Sound(UnityEngine *_engine) : _vm(_engine) {
 	_speechSoundHandle = NULL;
-	_sfxSoundHandle = NULL;
 	_musicSoundHandle = NULL;
+	_sfxCacheSize = 0;
+
+	for (uint i = 0; i < kSfxVoiceCount; i++) {
+		_sfxVoices[i].stream = NULL;
+		_sfxVoices[i].source = NULL;
+		_sfxVoices[i].priority = kSfxPriorityNormal;
+		_sfxVoices[i].started = 0;
+		_sfxVoices[i].plays = _sfxVoices[i].stolen = 0;
+	}
+	_sfxStarted = 0;
+	_sfxDropped = 0;
+
+	_musicWorld = _musicScreen = 0xffffffff;
+	_musicConditionObject = NULL;
+	_musicChoice = NULL;
+	_musicChoiceActive = false;
 }
 
 Sound::~Sound() {
+	if (_sfxVoices[0].stream)
+		stopSfx();
+	for (uint i = 0; i < kSfxVoiceCount; i++)
+		delete _sfxVoices[i].stream;
+	clearSfxCache();
+	clearMusicPrefetch();
+	clearSpeechPrefetch();
+
 	delete _speechSoundHandle;
-	delete _sfxSoundHandle;
 	delete _musicSoundHandle;
 }
 
 void Sound::init() {
-	_sfxSoundHandle = new Audio::SoundHandle();
+	for (uint i = 0; i < kSfxVoiceCount; i++)
+		_sfxVoices[i].stream = new SfxVoiceStream();
 	_speechSoundHandle = new Audio::SoundHandle();
 	_musicSoundHandle = new Audio::SoundHandle();
 }
@@ -120,28 +344,237 @@ void Sound::init() {
 void Sound::playSpeech(Common::String name) {
 	debug(1, "playing speech: %s", name.c_str());
 	stopSpeech();
-	Common::SeekableReadStream *audioFileStream = _vm->data.openFile(name);
-	Audio::AudioStream *sampleStream = new Unity_ADPCMStream(
-		audioFileStream, DisposeAfterUse::YES, audioFileStream->size(), 22050, 1);
+	Audio::RewindableAudioStream *sampleStream = takePrefetchedSpeech(name);
+	if (!sampleStream) {
+		Common::SeekableReadStream *audioFileStream = _vm->data.openFile(name);
+		sampleStream = new Unity_ADPCMStream(
+			audioFileStream, DisposeAfterUse::YES, audioFileStream->size(), 22050, 1);
+	}
 	if (!sampleStream) error("couldn't make sample stream");
 	_vm->_mixer->playStream(Audio::Mixer::kSpeechSoundType, _speechSoundHandle, sampleStream);
+
+	// Lines are said in order, so this one and any before it are done with;
+	// a line we weren't expecting means the conversation went elsewhere.
+	uint i;
+	for (i = 0; i < _expectedSpeech.size(); i++)
+		if (_expectedSpeech[i] == name)
+			break;
+	if (i == _expectedSpeech.size()) {
+		_expectedSpeech.clear();
+		clearSpeechPrefetch();
+		return;
+	}
+	for (uint j = 0; j <= i; j++)
+		_expectedSpeech.remove_at(0);
+
+	// (the mixer is already playing this line while we do this)
+	prefetchExpectedSpeech();
 }
 
-void Sound::playSfx(Common::String name) {
-	debug(1, "playing sfx: %s", name.c_str());
-	stopSfx();
+// the speech a conversation is about to play, the first line first
+void Sound::expectSpeech(const Common::Array<Common::String> &names) {
+	_expectedSpeech = names;
+
+	// drop anything prefetched which isn't coming up any more
+	for (uint i = 0; i < _speechPrefetch.size(); ) {
+		bool wanted = false;
+		for (uint j = 0; j < names.size(); j++)
+			if (names[j] == _speechPrefetch[i].filename)
+				wanted = true;
+		if (wanted) {
+			i++;
+			continue;
+		}
+		delete _speechPrefetch[i].stream;
+		_speechPrefetch.remove_at(i);
+	}
+}
+
+void Sound::prefetchExpectedSpeech() {
+	for (uint i = 0; i < _expectedSpeech.size(); i++) {
+		if (_speechPrefetch.size() >= kSpeechPrefetchCount)
+			break;
+
+		const Common::String &name = _expectedSpeech[i];
+		bool done = false;
+		for (uint j = 0; j < _speechPrefetch.size(); j++)
+			if (_speechPrefetch[j].filename == name)
+				done = true;
+		// (leave missing files for playSpeech to complain about)
+		if (done || !_vm->data.hasFile(name))
+			continue;
+
+		PrefetchedSpeech prefetch;
+		prefetch.filename = name;
+		Common::SeekableReadStream *audioFileStream = _vm->data.openFile(name);
+		prefetch.stream = new PrefetchedAudioStream(new Unity_ADPCMStream(
+			audioFileStream, DisposeAfterUse::YES, audioFileStream->size(), 22050, 1));
+		_speechPrefetch.push_back(prefetch);
+	}
+}
+
+Audio::RewindableAudioStream *Sound::takePrefetchedSpeech(const Common::String &name) {
+	for (uint i = 0; i < _speechPrefetch.size(); i++) {
+		if (_speechPrefetch[i].filename != name)
+			continue;
+		Audio::RewindableAudioStream *stream = _speechPrefetch[i].stream;
+		_speechPrefetch.remove_at(i);
+		return stream;
+	}
+	return NULL;
+}
+
+void Sound::clearSpeechPrefetch() {
+	for (uint i = 0; i < _speechPrefetch.size(); i++)
+		delete _speechPrefetch[i].stream;
+	_speechPrefetch.clear();
+}
+
+Sound::CachedSfx *Sound::findCachedSfx(const Common::String &name) {
+	for (Common::List<CachedSfx>::iterator i = _sfxCache.begin(); i != _sfxCache.end(); i++) {
+		if (i->name != name)
+			continue;
+		if (i != _sfxCache.begin()) {
+			_sfxCache.push_front(*i);
+			_sfxCache.erase(i);
+		}
+		return &_sfxCache.front();
+	}
+	return NULL;
+}
+
+// decode the whole of a (short) sound effect, and take the stream
+Sound::CachedSfx *Sound::cacheSfx(const Common::String &name, Common::SeekableReadStream *stream) {
+	// (4 samples for every 2 bytes, rounded up)
+	uint32 maxSamples = ((stream->size() + 1) / 2) * 4;
+
+	CachedSfx entry;
+	entry.name = name;
+	entry.samples = new int16[maxSamples];
+	Audio::AudioStream *sampleStream = new Unity_ADPCMStream(stream, DisposeAfterUse::YES, stream->size(), 22050, 1);
+	entry.sampleCount = sampleStream->readBuffer(entry.samples, maxSamples);
+	delete sampleStream;
+
+	uint32 size = entry.sampleCount * 2;
+	while (!_sfxCache.empty() && _sfxCacheSize + size > kSfxCacheSize) {
+		stopSfxSource(_sfxCache.back().samples);
+		_sfxCacheSize -= _sfxCache.back().sampleCount * 2;
+		delete[] _sfxCache.back().samples;
+		_sfxCache.pop_back();
+	}
+
+	_sfxCache.push_front(entry);
+	_sfxCacheSize += size;
+	return &_sfxCache.front();
+}
+
+void Sound::clearSfxCache() {
+	for (Common::List<CachedSfx>::iterator i = _sfxCache.begin(); i != _sfxCache.end(); i++) {
+		stopSfxSource(i->samples);
+		delete[] i->samples;
+	}
+	_sfxCache.clear();
+	_sfxCacheSize = 0;
+}
+
+// decode a sound effect now, so it can be played without touching the disk
+void Sound::preloadSfx(const Common::String &name) {
+	if (findCachedSfx(name))
+		return;
 	Common::SeekableReadStream *audioFileStream = _vm->data.openFile(name);
-	Audio::AudioStream *sampleStream = new Unity_ADPCMStream(
-		audioFileStream, DisposeAfterUse::YES, audioFileStream->size(), 22050, 1);
-	if (!sampleStream) error("couldn't make sample stream");
-	_vm->_mixer->playStream(Audio::Mixer::kSFXSoundType, _sfxSoundHandle, sampleStream);
+	if (audioFileStream->size() > kSfxCacheMaxClip) {
+		delete audioFileStream;
+		return;
+	}
+	cacheSfx(name, audioFileStream);
+}
+
+// Find a voice for a new sound effect, and stop whatever it was playing.
+// A sound which is already playing is restarted on the same voice; otherwise
+// a free voice is used, or the oldest of the least important ones, if it's
+// no more important than the new sound. Returns NULL if there's no room.
+Sound::SfxVoice *Sound::allocateSfxVoice(const void *source, SfxPriority priority) {
+	SfxVoice *voice = NULL;
+	for (uint i = 0; i < kSfxVoiceCount && !voice; i++)
+		if (source && _sfxVoices[i].source == source)
+			voice = &_sfxVoices[i];
+	for (uint i = 0; i < kSfxVoiceCount && !voice; i++)
+		if (!_vm->_mixer->isSoundHandleActive(_sfxVoices[i].handle))
+			voice = &_sfxVoices[i];
+	if (!voice) {
+		for (uint i = 0; i < kSfxVoiceCount; i++) {
+			SfxVoice &candidate = _sfxVoices[i];
+			if (candidate.priority > priority)
+				continue;
+			if (!voice || candidate.priority < voice->priority ||
+				(candidate.priority == voice->priority && candidate.started < voice->started))
+				voice = &candidate;
+		}
+		if (!voice) {
+			_sfxDropped++;
+			return NULL;
+		}
+		voice->stolen++;
+	}
+
+	_vm->_mixer->stopHandle(voice->handle);
+	voice->source = source;
+	voice->priority = priority;
+	voice->started = _sfxStarted++;
+	voice->plays++;
+	return voice;
+}
+
+// stop any voice playing from data which is about to go away
+void Sound::stopSfxSource(const void *source) {
+	for (uint i = 0; i < kSfxVoiceCount; i++) {
+		if (_sfxVoices[i].source != source)
+			continue;
+		_vm->_mixer->stopHandle(_sfxVoices[i].handle);
+		_sfxVoices[i].source = NULL;
+	}
+}
+
+void Sound::playSfx(Common::String name, SfxPriority priority) {
+	debug(1, "playing sfx: %s", name.c_str());
+
+	CachedSfx *cached = findCachedSfx(name);
+	Common::SeekableReadStream *audioFileStream = NULL;
+	if (!cached) {
+		audioFileStream = _vm->data.openFile(name);
+		if (audioFileStream->size() <= kSfxCacheMaxClip) {
+			cached = cacheSfx(name, audioFileStream);
+			audioFileStream = NULL;
+		}
+	}
+
+	SfxVoice *voice = allocateSfxVoice(cached ? cached->samples : NULL, priority);
+	if (!voice) {
+		debug(1, "no voice free for sfx %s", name.c_str());
+		delete audioFileStream;
+		return;
+	}
+
+	if (cached) {
+		voice->stream->playSamples(cached->samples, cached->sampleCount);
+		_vm->_mixer->playStream(Audio::Mixer::kSFXSoundType, &voice->handle, voice->stream,
+			-1, Audio::Mixer::kMaxChannelVolume, 0, DisposeAfterUse::NO);
+	} else {
+		// too long to keep around, so stream it
+		Audio::AudioStream *sampleStream = new Unity_ADPCMStream(
+			audioFileStream, DisposeAfterUse::YES, audioFileStream->size(), 22050, 1);
+		_vm->_mixer->playStream(Audio::Mixer::kSFXSoundType, &voice->handle, sampleStream);
+	}
 }
 
 void Sound::playMusic(Common::String name, byte volume, int loopPos) {
 	debug(1, "playing music: %s, loop %d, vol %d", name.c_str(), loopPos, volume);
-	Common::SeekableReadStream *audioFileStream = _vm->data.openFile(name);
-	Audio::RewindableAudioStream *sampleStream = new Unity_ADPCMStream(
-		audioFileStream, DisposeAfterUse::YES, audioFileStream->size(), 22050, 2, loopPos);
+	Audio::RewindableAudioStream *sampleStream = takePrefetchedMusic(name, loopPos);
+	if (!sampleStream) {
+		Common::SeekableReadStream *audioFileStream = _vm->data.openFile(name);
+		sampleStream = new Unity_ADPCMStream(
+			audioFileStream, DisposeAfterUse::YES, audioFileStream->size(), 22050, 2, loopPos);
+	}
 	if (!sampleStream) error("couldn't make sample stream");
 	Audio::AudioStream *audioStream = sampleStream;
 	if (loopPos != -1)
@@ -150,7 +583,14 @@ void Sound::playMusic(Common::String name, byte volume, int loopPos) {
 }
 
 bool Sound::sfxPlaying() {
-	return _vm->_mixer->isSoundHandleActive(*_sfxSoundHandle);
+	for (uint i = 0; i < kSfxVoiceCount; i++)
+		if (_vm->_mixer->isSoundHandleActive(_sfxVoices[i].handle))
+			return true;
+	return false;
+}
+
+bool Sound::sfxVoicePlaying(uint voice) {
+	return _vm->_mixer->isSoundHandleActive(_sfxVoices[voice].handle);
 }
 
 bool Sound::musicPlaying() {
@@ -162,7 +602,8 @@ bool Sound::speechPlaying() {
 }
 
 void Sound::stopSfx() {
-	_vm->_mixer->stopHandle(*_sfxSoundHandle);
+	for (uint i = 0; i < kSfxVoiceCount; i++)
+		_vm->_mixer->stopHandle(_sfxVoices[i].handle);
 }
 
 void Sound::stopMusic() {
@@ -173,12 +614,14 @@ void Sound::stopSpeech() {
 	_vm->_mixer->stopHandle(*_speechSoundHandle);
 }
 
-void Sound::playAudioBuffer(unsigned int length, byte *data) {
-	Common::MemoryReadStream *audioFileStream = new Common::MemoryReadStream(data, length);
-	Audio::AudioStream *sampleStream = new Unity_ADPCMStream(
-		audioFileStream, DisposeAfterUse::YES, audioFileStream->size(), 22050, 1);
-	if (!sampleStream) error("couldn't make sample stream");
-	_vm->_mixer->playStream(Audio::Mixer::kSFXSoundType, _sfxSoundHandle, sampleStream);
+// sound embedded in a sprite; this is called while animating, so it mustn't allocate
+void Sound::playAudioBuffer(unsigned int length, byte *data, SfxPriority priority) {
+	SfxVoice *voice = allocateSfxVoice(data, priority);
+	if (!voice)
+		return;
+	voice->stream->playADPCM(data, length);
+	_vm->_mixer->playStream(Audio::Mixer::kSFXSoundType, &voice->handle, voice->stream,
+		-1, Audio::Mixer::kMaxChannelVolume, 0, DisposeAfterUse::NO);
 }
 
 void Sound::playIntroMusic() {
@@ -187,151 +630,205 @@ void Sound::playIntroMusic() {
 	// FIXME
 }
 
-void Sound::updateMusic() {
-	if (musicPlaying())
-		return;
+// The music for each away team screen, with loop offsets and volumes.
+// A screen of 0 covers the rest of that world. Entries with a condition
+// object only apply if that object's active flag is as given.
+static const struct MusicMapEntry {
+	byte world, screen;
+	const char *filename;
+	byte volume;
+	uint32 loopPos;
+	byte condId, condScreen, condWorld; // condId is 0xff if there's no condition
+	bool condActive;
+} musicMap[] = {
+	// Allanor
+	{ 2, 1, "adamb01.rac", 0x1f, 0xab40, 0xff, 0, 0, false },
+	{ 2, 2, "adamb01.rac", 0x1f, 0xab40, 0xff, 0, 0, false },
+	{ 2, 3, "adamb03.rac", 0x19, 0xae80, 0xff, 0, 0, false },
+	{ 2, 4, "adamb04.rac", 0x1f, 0xcbc0, 0xff, 0, 0, false },
+	{ 2, 5, "adamb04.rac", 0x1f, 0xcbc0, 0xff, 0, 0, false },
+	{ 2, 6, "adamb04.rac", 0x1f, 0xcbc0, 0xff, 0, 0, false },
+	{ 2, 7, "adamb04.rac", 0x1f, 0xcbc0, 0xff, 0, 0, false },
+	{ 2, 8, "adamb08.rac", 0x19, 0xa1c0, 0xff, 0, 0, false },
+	{ 2, 9, "adamb08.rac", 0x19, 0xa1c0, 0xff, 0, 0, false },
+	{ 2, 10, "adamb08.rac", 0x19, 0xa1c0, 0xff, 0, 0, false },
+	{ 2, 12, "adamb08.rac", 0x19, 0xa1c0, 0xff, 0, 0, false },
+	{ 2, 0, "adamb11.rac", 0x19, 0xab40, 0xff, 0, 0, false },
+
+	// Zoo World
+	{ 3, 3, "zootree.rac", 0x30, 0x548e, 0xff, 0, 0, false },
+	{ 3, 10, "zootree.rac", 0x30, 0x548e, 0xff, 0, 0, false },
+	{ 3, 4, "zoolab.rac", 0x30, 0x5b9c, 0xff, 0, 0, false },
+	{ 3, 6, "zoodesrt.rac", 0x30, 0x8b82, 0xff, 0, 0, false },
+	{ 3, 7, "zooswamp.rac", 0x30, 0x5c08, 0xff, 0, 0, false },
+	{ 3, 8, "zoosulfr.rac", 0x30, 0x419c, 0xff, 0, 0, false },
+	{ 3, 16, "powersta.rac", 0x30, 0xad80, 0xff, 0, 0, false },
+	{ 3, 0, "zoobirds.rac", 0x30, 0x1b1ee, 0xff, 0, 0, false },
+
+	// Lab (Orbital Station)
+	{ 4, 2, "lbbigfar.rac", 0x3f, 0x3160, 0xff, 0, 0, false },
+	{ 4, 3, "lbbigfar.rac", 0x3f, 0x3160, 0xff, 0, 0, false },
+	{ 4, 4, "lbbigfar.rac", 0x3f, 0x3160, 0xff, 0, 0, false },
+	// probe room - music depends on whether probe is still present
+	// (the condition is object 4 of world 3 screen 6, as the old code had it)
+	{ 4, 6, "probroom.rac", 0x3f, 0x5a00, 4, 6, 3, true },
+	{ 4, 6, "lbbignr.rac", 0x3f, 0x4ebc, 4, 6, 3, false },
+	{ 4, 10, "lbctnear.rac", 0x3f, 0x4896, 0xff, 0, 0, false },
+	{ 4, 11, "lbctnear.rac", 0x3f, 0x4896, 0xff, 0, 0, false },
+	{ 4, 0, "lbctrfar.rac", 0x3f, 0x4e9c, 0xff, 0, 0, false },
+
+	// Frigis
+	{ 5, 1, "s5amb01.rac", 0x1f, 0xa7c0, 0xff, 0, 0, false },
+	{ 5, 2, "s5amb01.rac", 0x1f, 0xa7c0, 0xff, 0, 0, false },
+	{ 5, 3, "s5amb03.rac", 0x1f, 0xeb80, 0xff, 0, 0, false },
+	{ 5, 4, "s5amb04.rac", 0x1f, 0xb778, 0xff, 0, 0, false },
+	{ 5, 5, "s5amb05.rac", 0x1f, 0x9a00, 0xff, 0, 0, false },
+	{ 5, 6, "s5amb06.rac", 0x1f, 0xb0c0, 0xff, 0, 0, false },
+	{ 5, 7, "s5amb07.rac", 0x1f, 0xb980, 0xff, 0, 0, false },
+	{ 5, 0, "s5amb08.rac", 0x1f, 0x13388, 0xff, 0, 0, false },
+
+	// Unity Device
+	{ 6, 1, "udamb01.rac", 0x1f, 0x4c00, 0xff, 0, 0, false },
+	{ 6, 2, "udamb02.rac", 0x1f, 0x6c32, 0xff, 0, 0, false },
+	{ 6, 6, "udamb06.rac", 0x1f, 0x7a40, 0xff, 0, 0, false },
+	{ 6, 9, "udamb09.rac", 0x1f, 0x62c0, 0xff, 0, 0, false },
+	{ 6, 12, "udamb12.rac", 0x1f, 0x5c80, 0xff, 0, 0, false },
+	// default to Horst III music
+	{ 6, 0, "h3amb01.rac", 0x2f, 0x162b0, 0xff, 0, 0, false },
+
+	// Horst III
+	{ 7, 0, "h3amb01.rac", 0x2f, 0x162b0, 0xff, 0, 0, false }
+};
 
-	// This is hard-coded, with loop offsets and volumes.
-	switch (_vm->data._currentScreen.world) {
-	case 2:
-		// Allanor
-		switch (_vm->data._currentScreen.screen) {
-		case 1:
-		case 2:
-			playMusic("adamb01.rac", 0x1f, 0xab40);
-			break;
-		case 3:
-			playMusic("adamb03.rac", 0x19, 0xae80);
-			break;
-		case 4:
-		case 5:
-		case 6:
-		case 7:
-			playMusic("adamb04.rac", 0x1f, 0xcbc0);
-			break;
-		case 8:
-		case 9:
-		case 10:
-		case 12:
-			playMusic("adamb08.rac", 0x19, 0xa1c0);
-			break;
-		default:
-			playMusic("adamb11.rac", 0x19, 0xab40);
-			break;
-		}
-		break;
-
-	case 3:
-		// Zoo World
-		switch (_vm->data._currentScreen.screen) {
-		case 3:
-		case 10:
-			playMusic("zootree.rac", 0x30, 0x548e);
-			break;
-		case 4:
-			playMusic("zoolab.rac", 0x30, 0x5b9c);
-			break;
-		case 6:
-			playMusic("zoodesrt.rac", 0x30, 0x8b82);
-			break;
-		case 7:
-			playMusic("zooswamp.rac", 0x30, 0x5c08);
-			break;
-		case 8:
-			playMusic("zoosulfr.rac", 0x30, 0x419c);
-			break;
-		case 16:
-			playMusic("powersta.rac", 0x30, 0xad80);
-			break;
-		default:
-			playMusic("zoobirds.rac", 0x30, 0x1b1ee);
-			break;
-		}
-		break;
-
-	case 4:
-		// Lab (Orbital Station)
-		switch (_vm->data._currentScreen.screen) {
-		case 2:
-		case 3:
-		case 4:
-			playMusic("lbbigfar.rac", 0x3f, 0x3160);
-			break;
-		case 6:
-			// Probe room - music depends on whether probe is still present.
-			if (_vm->data.getObject(objectID(4, 6, 3))->flags & OBJFLAG_ACTIVE)
-				playMusic("probroom.rac", 0x3f, 0x5a00);
-			else
-				playMusic("lbbignr.rac", 0x3f, 0x4ebc);
-			break;
-		case 10:
-		case 11:
-			playMusic("lbctnear.rac", 0x3f, 0x4896);
-			break;
-		default:
-			playMusic("lbctrfar.rac", 0x3f, 0x4e9c);
+// the music for a screen, given the state of its condition object (if any)
+static const MusicMapEntry *findMusic(unsigned int world, unsigned int screen, bool condActive) {
+	const MusicMapEntry *fallback = NULL;
+	for (uint i = 0; i < ARRAYSIZE(musicMap); i++) {
+		const MusicMapEntry &entry = musicMap[i];
+		if (entry.world != world)
+			continue;
+		if (entry.screen == 0 && !fallback)
+			fallback = &entry;
+		if (entry.screen != screen)
+			continue;
+		if (entry.condId == 0xff || entry.condActive == condActive)
+			return &entry;
+	}
+	return fallback;
+}
+
+// open a music file and decode its start, so it can start without a gap
+void Sound::prefetchMusic(const Common::String &name, uint32 loopPos) {
+	for (uint i = 0; i < _musicPrefetch.size(); i++)
+		if (_musicPrefetch[i].filename == name && _musicPrefetch[i].loopPos == loopPos)
+			return;
+
+	PrefetchedMusic prefetch;
+	prefetch.filename = name;
+	prefetch.loopPos = loopPos;
+	Common::SeekableReadStream *audioFileStream = _vm->data.openFile(name);
+	prefetch.stream = new PrefetchedAudioStream(new Unity_ADPCMStream(
+		audioFileStream, DisposeAfterUse::YES, audioFileStream->size(), 22050, 2, loopPos));
+	_musicPrefetch.push_back(prefetch);
+}
+
+Audio::RewindableAudioStream *Sound::takePrefetchedMusic(const Common::String &name, uint32 loopPos) {
+	for (uint i = 0; i < _musicPrefetch.size(); i++) {
+		if (_musicPrefetch[i].filename != name || _musicPrefetch[i].loopPos != loopPos)
+			continue;
+		Audio::RewindableAudioStream *stream = _musicPrefetch[i].stream;
+		_musicPrefetch.remove_at(i);
+		return stream;
+	}
+	return NULL;
+}
+
+void Sound::clearMusicPrefetch() {
+	for (uint i = 0; i < _musicPrefetch.size(); i++)
+		delete _musicPrefetch[i].stream;
+	_musicPrefetch.clear();
+}
+
+// a new screen: work out its music, and get the music of the screens near it ready
+void Sound::enterMusicScreen(unsigned int world, unsigned int screen) {
+	_musicWorld = world;
+	_musicScreen = screen;
+
+	_musicConditionObject = NULL;
+	for (uint i = 0; i < ARRAYSIZE(musicMap); i++) {
+		const MusicMapEntry &entry = musicMap[i];
+		if (entry.world == world && entry.screen == screen && entry.condId != 0xff) {
+			_musicConditionObject = _vm->data.getObject(objectID(entry.condId, entry.condScreen, entry.condWorld));
 			break;
 		}
-		break;
-
-	case 5:
-		// Frigis
-		switch (_vm->data._currentScreen.screen) {
-		case 1:
-		case 2:
-			playMusic("s5amb01.rac", 0x1f, 0xa7c0);
-			break;
-		case 3:
-			playMusic("s5amb03.rac", 0x1f, 0xeb80);
-			break;
-		case 4:
-			playMusic("s5amb04.rac", 0x1f, 0xb778);
-			break;
-		case 5:
-			playMusic("s5amb05.rac", 0x1f, 0x9a00);
-			break;
-		case 6:
-			playMusic("s5amb06.rac", 0x1f, 0xb0c0);
-			break;
-		case 7:
-			playMusic("s5amb07.rac", 0x1f, 0xb980);
-			break;
-		default:
-			playMusic("s5amb08.rac", 0x1f, 0x13388);
-			break;
+	}
+	bool active = _musicConditionObject && (_musicConditionObject->flags & OBJFLAG_ACTIVE);
+	_musicChoice = findMusic(world, screen, active);
+	_musicChoiceActive = active;
+
+	// The other music in this world, by how close the screen numbers are
+	// (the default music counts as close, since it covers most screens).
+	Common::Array<const MusicMapEntry *> candidates;
+	for (uint i = 0; i < ARRAYSIZE(musicMap); i++) {
+		const MusicMapEntry &entry = musicMap[i];
+		if (entry.world != world)
+			continue;
+		if (_musicChoice && !strcmp(entry.filename, _musicChoice->filename))
+			continue;
+		bool seen = false;
+		for (uint j = 0; j < candidates.size(); j++)
+			if (!strcmp(candidates[j]->filename, entry.filename))
+				seen = true;
+		if (!seen)
+			candidates.push_back(&entry);
+	}
+	Common::Array<const MusicMapEntry *> wanted;
+	for (int distance = 0; distance < 256 && wanted.size() < kMusicPrefetchCount; distance++) {
+		for (uint i = 0; i < candidates.size() && wanted.size() < kMusicPrefetchCount; i++) {
+			int entryDistance = candidates[i]->screen ? ABS((int)candidates[i]->screen - (int)screen) : 1;
+			if (entryDistance == distance)
+				wanted.push_back(candidates[i]);
 		}
-		break;
+	}
 
-	case 6:
-		// Unity Device
-		switch (_vm->data._currentScreen.screen) {
-		case 1:
-			playMusic("udamb01.rac", 0x1f, 0x4c00);
-			break;
-		case 2:
-			playMusic("udamb02.rac", 0x1f, 0x6c32);
-			break;
-		case 6:
-			playMusic("udamb06.rac", 0x1f, 0x7a40);
-			break;
-		case 9:
-			playMusic("udamb09.rac", 0x1f, 0x62c0);
-			break;
-		case 12:
-			playMusic("udamb12.rac", 0x1f, 0x5c80);
-			break;
-		default:
-			// default to Horst III music
-			playMusic("h3amb01.rac", 0x2f, 0x162b0);
-			break;
+	// Drop whatever we won't need now, then fetch the rest. The music for
+	// this screen is about to be played, so keep that if we have it.
+	for (uint i = 0; i < _musicPrefetch.size(); ) {
+		bool keep = _musicChoice && _musicPrefetch[i].filename == _musicChoice->filename
+			&& _musicPrefetch[i].loopPos == _musicChoice->loopPos;
+		for (uint j = 0; j < wanted.size(); j++)
+			if (_musicPrefetch[i].filename == wanted[j]->filename && _musicPrefetch[i].loopPos == wanted[j]->loopPos)
+				keep = true;
+		if (keep) {
+			i++;
+			continue;
 		}
-		break;
+		delete _musicPrefetch[i].stream;
+		_musicPrefetch.remove_at(i);
+	}
+	for (uint i = 0; i < wanted.size(); i++)
+		prefetchMusic(wanted[i]->filename, wanted[i]->loopPos);
+}
+
+void Sound::updateMusic() {
+	const Screen &screen = _vm->data._currentScreen;
+	if (screen.world != _musicWorld || screen.screen != _musicScreen)
+		enterMusicScreen(screen.world, screen.screen);
 
-	case 7:
-		// Horst III
-		playMusic("h3amb01.rac", 0x2f, 0x162b0);
-		break;
+	if (musicPlaying())
+		return;
+
+	// only look again if the condition object changed
+	if (_musicConditionObject) {
+		bool active = (_musicConditionObject->flags & OBJFLAG_ACTIVE) != 0;
+		if (active != _musicChoiceActive) {
+			_musicChoice = findMusic(_musicWorld, _musicScreen, active);
+			_musicChoiceActive = active;
+		}
 	}
+
+	if (_musicChoice)
+		playMusic(_musicChoice->filename, _musicChoice->volume, _musicChoice->loopPos);
 }
 
 }
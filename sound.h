@@ -18,21 +18,48 @@
 #define UNITY_SOUND_H
 
 #include "unity.h"
+#include "common/list.h"
 #include "audio/mixer.h"
 
+namespace Audio {
+	class RewindableAudioStream;
+}
+
 namespace Unity {
 
+struct MusicMapEntry;
+class SfxVoiceStream;
+
+enum {
+	// how many sound effects can play at once
+	kSfxVoiceCount = 8
+};
+
+// when all the sfx voices are busy, a new sound only replaces one which
+// isn't more important than it
+enum SfxPriority {
+	kSfxPriorityNormal, // sprite sounds
+	kSfxPriorityHigh // interface sounds
+};
+
+// the IMA ADPCM variant used by .rac music, sfx and speech
+Audio::RewindableAudioStream *makeUnityADPCMStream(Common::SeekableReadStream *stream,
+	DisposeAfterUse::Flag disposeAfterUse, uint32 size, int channels, uint32 loopPoint = 0);
+
 class Sound {
 public:
 	Sound(UnityEngine *engine);
 	~Sound();
 
 	void init();
-	void playAudioBuffer(unsigned int length, byte *data);
-	void playSfx(Common::String name);
+	void playAudioBuffer(unsigned int length, byte *data, SfxPriority priority = kSfxPriorityNormal);
+	void playSfx(Common::String name, SfxPriority priority = kSfxPriorityHigh);
+	void preloadSfx(const Common::String &name);
 	void playSpeech(Common::String name);
+	void expectSpeech(const Common::Array<Common::String> &names);
 	void playMusic(Common::String name, byte volume = 0xff, int loopPos = -1);
 	bool sfxPlaying();
+	bool sfxVoicePlaying(uint voice);
 	bool speechPlaying();
 	bool musicPlaying();
 	void stopSfx();
@@ -42,11 +69,71 @@ public:
 	void playIntroMusic();
 	void updateMusic();
 
+	struct SfxVoice {
+		Audio::SoundHandle handle;
+		SfxVoiceStream *stream;
+		const void *source; // the data being played, NULL if none or unknown
+		SfxPriority priority;
+		uint32 started; // the value of _sfxStarted at the time
+
+		// (for the 'sfx' console command)
+		uint32 plays, stolen;
+	};
+	const SfxVoice &getSfxVoice(uint voice) const { return _sfxVoices[voice]; }
+	uint32 getSfxDropped() const { return _sfxDropped; }
+	void stopSfxSource(const void *source);
+
 protected:
 	UnityEngine *_vm;
-	Audio::SoundHandle *_sfxSoundHandle;
 	Audio::SoundHandle *_speechSoundHandle;
 	Audio::SoundHandle *_musicSoundHandle;
+
+	SfxVoice _sfxVoices[kSfxVoiceCount];
+	uint32 _sfxStarted;
+	uint32 _sfxDropped; // sounds not played because no voice could be used
+	SfxVoice *allocateSfxVoice(const void *source, SfxPriority priority);
+
+	// fully decoded short sound effects, most recently used first
+	struct CachedSfx {
+		Common::String name;
+		int16 *samples;
+		uint32 sampleCount;
+	};
+	Common::List<CachedSfx> _sfxCache;
+	uint32 _sfxCacheSize; // in bytes
+	CachedSfx *findCachedSfx(const Common::String &name);
+	CachedSfx *cacheSfx(const Common::String &name, Common::SeekableReadStream *stream);
+	void clearSfxCache();
+
+	// the away team music (see updateMusic), and the screen it's for
+	unsigned int _musicWorld, _musicScreen;
+	Object *_musicConditionObject;
+	const MusicMapEntry *_musicChoice;
+	bool _musicChoiceActive;
+	void enterMusicScreen(unsigned int world, unsigned int screen);
+
+	// music for nearby screens, opened with its start already decoded
+	struct PrefetchedMusic {
+		Common::String filename;
+		uint32 loopPos;
+		Audio::RewindableAudioStream *stream;
+	};
+	Common::Array<PrefetchedMusic> _musicPrefetch;
+	void prefetchMusic(const Common::String &name, uint32 loopPos);
+	Audio::RewindableAudioStream *takePrefetchedMusic(const Common::String &name, uint32 loopPos);
+	void clearMusicPrefetch();
+
+	// the speech which a conversation expects to play next, in order, and
+	// the start of some of it, decoded while the current line plays
+	Common::Array<Common::String> _expectedSpeech;
+	struct PrefetchedSpeech {
+		Common::String filename;
+		Audio::RewindableAudioStream *stream;
+	};
+	Common::Array<PrefetchedSpeech> _speechPrefetch;
+	void prefetchExpectedSpeech();
+	Audio::RewindableAudioStream *takePrefetchedSpeech(const Common::String &name);
+	void clearSpeechPrefetch();
 };
 
 }
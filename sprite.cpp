@@ -47,14 +47,16 @@ const char OBJS[4] = {'S', 'J', 'B', 'O' };
 const char RGBP[4] = {'P', 'B', 'G', 'R' };
 const char BSON[4] = {'N', 'O', 'S', 'B' };
 
-Sprite::Sprite(Common::SeekableReadStream *_str) : _stream(_str) {
+Sprite::Sprite(Common::SeekableReadStream *_str, bool buildMasks) : _stream(_str), _buildMasks(buildMasks) {
 	assert(_stream);
 
 	_isSprite = false;
 
 	SpriteEntry *temp = readBlock();
-	if (temp && (temp->type == se_Sprite || temp->type == se_SpeechSprite))
+	if (temp && (temp->type == se_Sprite || temp->type == se_SpeechSprite)) {
 		delete[] ((SpriteEntrySprite *)temp)->data;
+		delete[] ((SpriteEntrySprite *)temp)->mask;
+	}
 	else if (temp && temp->type == se_Audio)
 		delete[] ((SpriteEntryAudio *)temp)->data;
 	delete temp;
@@ -66,8 +68,10 @@ Sprite::Sprite(Common::SeekableReadStream *_str) : _stream(_str) {
 
 Sprite::~Sprite() {
 	for (unsigned int i = 0; i < _entries.size(); i++) {
-		if (_entries[i] && (_entries[i]->type == se_Sprite || _entries[i]->type == se_SpeechSprite))
+		if (_entries[i] && (_entries[i]->type == se_Sprite || _entries[i]->type == se_SpeechSprite)) {
 			delete[] ((SpriteEntrySprite *)_entries[i])->data;
+			delete[] ((SpriteEntrySprite *)_entries[i])->mask;
+		}
 		else if (_entries[i] && _entries[i]->type == se_Audio)
 			delete[] ((SpriteEntryAudio *)_entries[i])->data;
 		delete _entries[i];
@@ -101,8 +105,10 @@ SpriteEntry *Sprite::parseBlock(char blockType[4], uint32 size) {
 		uint32 unknown = _stream->readUint32LE();
 		assert(unknown = 0x1000);
 		SpriteEntry *temp = readBlock();
-		if (temp && (temp->type == se_Sprite || temp->type == se_SpeechSprite))
+		if (temp && (temp->type == se_Sprite || temp->type == se_SpeechSprite)) {
 			delete[] ((SpriteEntrySprite *)temp)->data;
+			delete[] ((SpriteEntrySprite *)temp)->mask;
+		}
 		else if (temp && temp->type == se_Audio)
 			delete[] ((SpriteEntryAudio *)temp)->data;
 		delete temp;
@@ -290,6 +296,8 @@ void Sprite::readCompressedImage(uint32 size, SpriteEntrySprite *img) {
 	img->height = _stream->readUint32LE();
 	delete[] img->data;
 	img->data = 0;
+	delete[] img->mask;
+	img->mask = 0;
 
 	uint16 unknown3 = _stream->readUint16LE();
 	uint16 unknown4 = _stream->readUint16LE();
@@ -336,6 +344,25 @@ void Sprite::readCompressedImage(uint32 size, SpriteEntrySprite *img) {
 	}
 
 	delete[] buf;
+
+	// masks are only used for hit testing, so speech sprites don't need them
+	if (_buildMasks && img->type == se_Sprite)
+		buildMask(img);
+}
+
+void Sprite::buildMask(SpriteEntrySprite *img) {
+	unsigned int pitch = (img->width + 7) / 8;
+	img->mask = new byte[pitch * img->height];
+	memset(img->mask, 0, pitch * img->height);
+
+	const byte *src = img->data;
+	for (unsigned int y = 0; y < img->height; y++) {
+		byte *row = img->mask + y * pitch;
+		for (unsigned int x = 0; x < img->width; x++) {
+			if (*src++ != COLOUR_BLANK)
+				row[x >> 3] |= 0x80 >> (x & 7);
+		}
+	}
 }
 
 void Sprite::decodeSpriteTypeOne(byte *buf, unsigned int size, byte *data, unsigned int width, unsigned int height) {
@@ -57,7 +57,8 @@ struct SpriteEntrySprite : public SpriteEntry {
 	unsigned int width;
 	unsigned int height;
 	byte *data;
-	SpriteEntrySprite() : SpriteEntry(se_Sprite), data(0) { }
+	byte *mask; // 1bpp opacity (rows padded to bytes, MSB first), if requested
+	SpriteEntrySprite() : SpriteEntry(se_Sprite), data(0), mask(0) { }
 };
 
 struct SpriteEntryPalette : public SpriteEntry {
@@ -114,7 +115,7 @@ struct SpriteEntrySetFlag : public SpriteEntry {
 
 class Sprite {
 public:
-	Sprite(Common::SeekableReadStream *_str);
+	Sprite(Common::SeekableReadStream *_str, bool buildMasks = false);
 	~Sprite();
 
 	SpriteEntry *getEntry(unsigned int entry) { return _entries[entry]; }
@@ -132,10 +133,12 @@ protected:
 	SpriteEntry *parseBlock(char blockType[4], uint32 size);
 
 	void readCompressedImage(uint32 size, SpriteEntrySprite *dest);
+	void buildMask(SpriteEntrySprite *img);
 	void decodeSpriteTypeOne(byte *buf, unsigned int size, byte *data, unsigned int width, unsigned int height);
 	void decodeSpriteTypeTwo(byte *buf, unsigned int size, byte *data, unsigned int targetsize);
 
 	bool _isSprite;
+	bool _buildMasks;
 };
 
 } // Unity
@@ -16,6 +16,7 @@
 
 #include "unity.h"
 #include "sprite_player.h"
+#include "graphics.h"
 #include "object.h"
 #include "sound.h"
 
@@ -27,12 +28,17 @@ namespace Unity {
 
 SpritePlayer::SpritePlayer(const char *filename, Object *par, UnityEngine *vm) : _parent(par), _vm(vm) {
 	_spriteStream = vm->data.openFile(filename);
-	_sprite = new Sprite(_spriteStream);
+	// only sprites belonging to objects are hit-tested, so only they need masks
+	_sprite = new Sprite(_spriteStream, par != NULL);
+	// (objects' sprites are advanced while their object is on screen)
+	if (!par)
+		_vm->addSpritePlayer(this);
 	_currentEntry = ~0;
 	_currentSprite = NULL;
 	_currentSpeechSprite = NULL;
 	_currentPalette = NULL;
 	_waitTarget = 0;
+	_nextUpdate = 0;
 
 	_normal.xpos = _normal.ypos = 0;
 	_normal.xadjust = _normal.yadjust = 0;
@@ -44,6 +50,18 @@ SpritePlayer::SpritePlayer(const char *filename, Object *par, UnityEngine *vm) :
 }
 
 SpritePlayer::~SpritePlayer() {
+	if (!_parent)
+		_vm->removeSpritePlayer(this);
+	if (_vm->_gfx)
+		_vm->_gfx->forgetScaledFrames(this);
+	// sfx voices play audio entries straight from the sprite
+	if (_vm->_snd) {
+		for (unsigned int i = 0; i < _sprite->getNumEntries(); i++) {
+			SpriteEntry *e = _sprite->getEntry(i);
+			if (e && e->type == se_Audio)
+				_vm->_snd->stopSfxSource(((SpriteEntryAudio *)e)->data);
+		}
+	}
 	delete _sprite;
 	delete _spriteStream;
 }
@@ -64,6 +82,7 @@ void SpritePlayer::startAnim(unsigned int a) {
 	assert(_currentEntry != (unsigned int)~0);
 
 	resetState();
+	_nextUpdate = 0;
 }
 
 unsigned int SpritePlayer::getCurrentWidth() {
@@ -81,6 +100,11 @@ byte *SpritePlayer::getCurrentData() {
 	return _currentSprite->data;
 }
 
+byte *SpritePlayer::getCurrentMask() {
+	assert(_currentSprite);
+	return _currentSprite->mask;
+}
+
 bool SpritePlayer::speaking() {
 	return _currentSpeechSprite != NULL;
 }
@@ -115,7 +139,42 @@ bool SpritePlayer::playing() {
 	return !(e->type == se_Pause || e->type == se_Exit);
 }
 
-void SpritePlayer::update() {
+enum {
+	// TODO: how long does a frame stay up without an explicit wait? just a guess
+	kSpriteFrameTime = 1000 / 15,
+	// after falling this far behind (e.g. during a movie), skip ahead instead
+	kSpriteMaxCatchUp = 1000
+};
+
+static const uint32 kSpriteNever = 0xffffffff;
+
+// run every step which has become due by the animation time 'now'
+void SpritePlayer::update(uint32 now) {
+	if (_nextUpdate < now && now - _nextUpdate > kSpriteMaxCatchUp)
+		_nextUpdate = now;
+
+	// when catching up, only play the sounds of the final step, rather than
+	// every sound we passed all at once
+	while (_nextUpdate <= now) {
+		_stepAudio.clear();
+		step(_nextUpdate);
+	}
+
+	for (unsigned int i = 0; i < _stepAudio.size(); i++)
+		_vm->_snd->playAudioBuffer(_stepAudio[i]->length, _stepAudio[i]->data);
+	_stepAudio.clear();
+}
+
+// move our timings from one clock to another (which is 'to' when this one is 'from')
+void SpritePlayer::rebaseTime(uint32 from, uint32 to) {
+	if (_nextUpdate && _nextUpdate != kSpriteNever)
+		_nextUpdate = _nextUpdate - from + to;
+	if (_waitTarget)
+		_waitTarget = _waitTarget - from + to;
+}
+
+// advance to the next frame, wait or stop, as if at animation time 'time'
+void SpritePlayer::step(uint32 time) {
 	unsigned int oldEntry = ~0;
 	while (true) {
 		SpriteEntry *e = _sprite->getEntry(_currentEntry);
@@ -134,8 +193,10 @@ void SpritePlayer::update() {
 			_currentEntry++;
 
 			e = _sprite->getEntry(_currentEntry);
-			if (e->type == se_Sprite || e->type == se_SpeechSprite)
+			if (e->type == se_Sprite || e->type == se_SpeechSprite) {
+				_nextUpdate = time + kSpriteFrameTime;
 				return;
+			}
 			break;
 
 		case se_SpeechSprite:
@@ -152,8 +213,10 @@ void SpritePlayer::update() {
 
 			_currentEntry++;
 			e = _sprite->getEntry(_currentEntry);
-			if (e->type == se_Sprite || e->type == se_SpeechSprite)
+			if (e->type == se_Sprite || e->type == se_SpeechSprite) {
+				_nextUpdate = time + kSpriteFrameTime;
 				return;
+			}
 			break;
 
 		case se_Palette:
@@ -200,6 +263,8 @@ void SpritePlayer::update() {
 
 		case se_Pause:
 		case se_Exit:
+			// nothing more happens until startAnim
+			_nextUpdate = kSpriteNever;
 			return;
 
 		case se_Mark:
@@ -224,22 +289,21 @@ void SpritePlayer::update() {
 				unsigned int wait = _vm->_rnd->getRandomNumberRng(0,
 					((SpriteEntryRandomWait *)e)->rand_amt);
 				// TODO: is /6 correct? see below
-				_waitTarget = g_system->getMillis() + ((SpriteEntryRandomWait *)e)->base/6 + wait/6;
-				return;
+				_waitTarget = time + ((SpriteEntryRandomWait *)e)->base/6 + wait/6;
 			}
 			// fall through
 		case se_Wait:
 			if (!_waitTarget) {
 				// TODO: is /6 correct? just a guess, so almost certainly not
 				// example values are 388, 777, 4777, 288, 666, 3188, 2188, 700, 200000, 1088, 272..
-				_waitTarget = g_system->getMillis() + ((SpriteEntryWait *)e)->wait/6;
-				return;
+				_waitTarget = time + ((SpriteEntryWait *)e)->wait/6;
 			}
-			if (_waitTarget < g_system->getMillis()) {
+			if (_waitTarget <= time) {
 				_waitTarget = 0;
 				_currentEntry++;
 				continue;
 			}
+			_nextUpdate = _waitTarget;
 			return;
 
 		case se_Jump:
@@ -254,8 +318,8 @@ void SpritePlayer::update() {
 			break;
 
 		case se_Audio:
-			_vm->_snd->playAudioBuffer(((SpriteEntryAudio *)e)->length,
-					((SpriteEntryAudio *)e)->data);
+			// played by update(), once we know this is the last step
+			_stepAudio.push_back((SpriteEntryAudio *)e);
 			_currentEntry++;
 			break;
 
@@ -31,7 +31,9 @@ public:
 
 	void startAnim(unsigned int a);
 	unsigned int getNumAnims() { return _sprite->getNumAnims(); }
-	void update();
+	void update(uint32 now);
+	void rebaseTime(uint32 from, uint32 to);
+	uint32 getNextUpdate() const { return _nextUpdate; }
 
 	bool playing();
 	bool valid() { return _currentSprite != 0; }
@@ -39,6 +41,7 @@ public:
 	unsigned int getCurrentHeight();
 	unsigned int getCurrentWidth();
 	byte *getCurrentData();
+	byte *getCurrentMask();
 
 	bool speaking();
 	unsigned int getSpeechHeight();
@@ -75,8 +78,11 @@ protected:
 	SpriteEntryPalette *_currentPalette;
 
 	unsigned int _waitTarget;
+	uint32 _nextUpdate; // animation time at which the next entries are due
+	Common::Array<SpriteEntryAudio *> _stepAudio; // sounds reached by the last step
 
 	void resetState();
+	void step(uint32 time);
 };
 
 } // Unity
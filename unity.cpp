@@ -29,6 +29,7 @@
 #include "common/config-manager.h"
 #include "common/error.h"
 #include "common/textconsole.h"
+#include "common/util.h"
 #include "engines/util.h"
 #include "common/events.h"
 #include "common/stream.h"
@@ -43,12 +44,15 @@
 namespace Unity {
 
 UnityEngine::UnityEngine(OSystem *syst) : Engine(syst), data(this) {
+	_gfx = NULL;
+	_snd = NULL;
 	DebugMan.addDebugChannel(kDebugResource, "Resource", "Resource Debug Flag");
 	DebugMan.addDebugChannel(kDebugSaveLoad, "Saveload", "Saveload Debug Flag");
 	DebugMan.addDebugChannel(kDebugScript, "Script", "Script Debug Flag");
 	DebugMan.addDebugChannel(kDebugGraphics, "Graphics", "Graphics Debug Flag");
 	DebugMan.addDebugChannel(kDebugSound, "Sound", "Sound Debug Flag");
 
+	_on_away_team = false;
 	_in_dialog = false;
 	_dialog_choosing = false;
 	_icon = NULL;
@@ -70,6 +74,11 @@ UnityEngine::UnityEngine(OSystem *syst) : Engine(syst), data(this) {
 	_viewscreenScreen = new ViewscreenScreen(this);
 	_currScreen = NULL;
 	_currScreenType = NoScreenType;
+
+	_benchmarking = false;
+	_benchmarkFrames = 0;
+	_benchmarkPresent = false;
+	memset(&_loadTimings, 0, sizeof(_loadTimings));
 }
 
 UnityEngine::~UnityEngine() {
@@ -80,8 +89,10 @@ UnityEngine::~UnityEngine() {
 	delete _viewscreenScreen;
 
 	delete _snd;
+	_snd = NULL;
 	delete _console;
 	delete _gfx;
+	_gfx = NULL;
 	// FIXME: Segfaults if deletion is done
 	//delete data.data;
 	delete _icon;
@@ -102,29 +113,22 @@ Common::Error UnityEngine::init() {
 	if (!data._data) {
 		error("couldn't open data file");
 	}
-	/*Common::ArchiveMemberList list;
-	data->listMembers(list);
-	for (Common::ArchiveMemberList::const_iterator file = list.begin(); file != list.end(); ++file) {
-		Common::String filename = (*file)->getName();
-		filename.toLowercase();
-		if (filename.hasSuffix(".spr") || filename.hasSuffix(".spt")) {
-			Common::SeekableReadStream *ourstr = (*file)->createReadStream();
-			debugN("trying '%s'\n", filename.c_str());
-			Sprite spr(ourstr);
-		}
-	}*/
 	SearchMan.add("sttngzip", data._data);
 
 	// DOS version only
 	data._instData = Common::makeZipArchive("STTNGINS.ZIP");
-	if (data._instData) {
+	if (data._instData)
 		SearchMan.add("sttnginszip", data._instData);
-	}
 
 	// Mac version only
 	const Common::FSNode gameDataDir(ConfMan.get("path"));
 	SearchMan.addDirectory(".movies", gameDataDir.getPath() + "/.movies");
 
+	// (after everything is in SearchMan, so loose files can be skipped)
+	data.indexZipFile("STTNG.ZIP");
+	if (data._instData)
+		data.indexZipFile("STTNGINS.ZIP");
+
 	return Common::kNoError;
 }
 
@@ -154,7 +158,9 @@ void UnityEngine::openLocation(unsigned int world, unsigned int screen) {
 	locstream->read(background, length);
 	background[length] = 0;
 
+	uint32 stageStart = _system->getMillis();
 	_gfx->setBackgroundImage(background);
+	_loadTimings.background += _system->getMillis() - stageStart;
 
 	// XXX: null-terminated in file?
 	length = locstream->readByte();
@@ -162,7 +168,9 @@ void UnityEngine::openLocation(unsigned int world, unsigned int screen) {
 	locstream->read(polygons, length);
 	polygons[length] = 0;
 
+	stageStart = _system->getMillis();
 	data.loadScreenPolys(polygons);
+	_loadTimings.polygons += _system->getMillis() - stageStart;
 
 	data._currentScreen.entrypoints.clear();
 	byte num_entrances = locstream->readByte();
@@ -181,6 +189,9 @@ void UnityEngine::openLocation(unsigned int world, unsigned int screen) {
 
 	delete locstream;
 
+	stageStart = _system->getMillis();
+	uint32 spriteTime = 0;
+
 	filename = Common::String::format("w%02x%02xobj.bst", world, screen);
 	locstream = data.openFile(filename);
 
@@ -199,12 +210,17 @@ void UnityEngine::openLocation(unsigned int world, unsigned int screen) {
 		debug(6, "reading obj '%s' (%s)", _name, _desc);
 
 		Object *obj = data.getObject(id);
+		uint32 spriteStart = _system->getMillis();
 		obj->loadSprite();
+		spriteTime += _system->getMillis() - spriteStart;
 		data._currentScreen.objects.push_back(obj);
 	}
 
 	delete locstream;
 
+	_loadTimings.sprites += spriteTime;
+	_loadTimings.objects += _system->getMillis() - stageStart - spriteTime;
+
 	filename = Common::String::format("w_%02dstrt.bst", world);
 	locstream = data.openFile(filename);
 
@@ -232,7 +248,8 @@ void UnityEngine::openLocation(unsigned int world, unsigned int screen) {
 	debug(6, "openLocation() unknown3: %d unknown4: %d", unknown3, unknown4);
 	debug(6, "openLocation() unknown5: %d unknown6: %d", unknown5, unknown6);
 
-	if (startup_screen != 0xffff) {
+	// (the benchmark only wants to look at the screen)
+	if (startup_screen != 0xffff && !_benchmarking) {
 		assert(startup_screen == screen);
 		if (target.id != 0xff) {
 			// TODO: only fire this on first load
@@ -256,16 +273,9 @@ void UnityEngine::openLocation(unsigned int world, unsigned int screen) {
 	delete locstream;
 }
 
-#define DIRECTION(x, y, x1, y1, x2, y2) (((int)y - y1)*(x2 - x1) - ((int)x - x1)*(y2 - y1))
-
 bool ScreenPolygon::insideTriangle(unsigned int x, unsigned int y, unsigned int &triangle) {
 	for (unsigned int i = 0; i < triangles.size(); i++) {
-		int direction = DIRECTION(x, y, triangles[i].points[0].x, triangles[i].points[0].y, triangles[i].points[1].x, triangles[i].points[1].y);
-		bool neg = direction < 0;
-		direction = DIRECTION(x, y, triangles[i].points[1].x, triangles[i].points[1].y, triangles[i].points[2].x, triangles[i].points[2].y);
-		if ((direction < 0) != neg) continue;
-		direction = DIRECTION(x, y, triangles[i].points[2].x, triangles[i].points[2].y, triangles[i].points[0].x, triangles[i].points[0].y);
-		if ((direction < 0) != neg) continue;
+		if (!triangles[i].contains(x, y)) continue;
 		triangle = i;
 		return true;
 	}
@@ -281,20 +291,26 @@ struct DrawOrderComparison {
 	}
 };
 
-Object *UnityEngine::objectAt(unsigned int x, unsigned int y) {
-	Common::Array<Object *> &objects = data._currentScreen.objects;
+bool ObjectHitEntry::contains(unsigned int x, unsigned int y) const {
+	if (!bounds.contains(x, y))
+		return false;
+	if (!mask || bounds.isEmpty())
+		return true;
 
-	for (unsigned int i = 0; i < objects.size(); i++) {
-		if (!(objects[i]->flags & OBJFLAG_ACTIVE)) continue;
-		if (objects[i]->flags & OBJFLAG_INVENTORY) continue;
-		if (objects[i]->width == (unsigned int)~0) continue;
+	// step through the mask the same way the scaler steps through the sprite
+	uint32 srcx = ((x - bounds.left) * ((maskWidth << 16) / bounds.width())) >> 16;
+	uint32 srcy = ((y - bounds.top) * ((maskHeight << 16) / bounds.height())) >> 16;
+	return (mask[srcy * ((maskWidth + 7) / 8) + (srcx >> 3)] & (0x80 >> (srcx & 7))) != 0;
+}
 
-		// TODO: should we be doing this like this, or keeping track of original coords, or what?
-		if (objects[i]->x - objects[i]->width/2 > x) continue;
-		if (objects[i]->x + objects[i]->width/2 < x) continue;
-		if (objects[i]->y - objects[i]->height > y) continue;
-		if (objects[i]->y < y) continue;
-		return objects[i];
+Object *UnityEngine::objectAt(unsigned int x, unsigned int y) {
+	// topmost (last drawn) first
+	for (unsigned int i = _hitIndex.size(); i-- > 0; ) {
+		const ObjectHitEntry &entry = _hitIndex[i];
+		if (!(entry.obj->flags & OBJFLAG_ACTIVE)) continue;
+		if (entry.obj->flags & OBJFLAG_INVENTORY) continue;
+		if (!entry.contains(x, y)) continue;
+		return entry.obj;
 	}
 
 	return 0;
@@ -302,11 +318,19 @@ Object *UnityEngine::objectAt(unsigned int x, unsigned int y) {
 
 void UnityEngine::clearObjects() {
 	data._currentScreen.objects.clear();
+	_hitIndex.clear();
 }
 
 void UnityEngine::removeObject(Object *obj) {
 	Common::Array<Object *> &objects = data._currentScreen.objects;
 
+	for (uint i = 0; i < _hitIndex.size(); ) {
+		if (_hitIndex[i].obj == obj)
+			_hitIndex.remove_at(i);
+		else
+			i++;
+	}
+
 	for (uint i = 0; i < objects.size(); i++) {
 		if (objects[i] != obj)
 			continue;
@@ -468,7 +492,7 @@ void UnityEngine::startupScreen() {
 		}
 		if (escape) break;
 
-		p->update();
+		updateSprites(_system->getMillis());
 		if (!p->playing()) {
 			if (!waiting) {
 				// arbitary 4 second wait, original waits until background
@@ -489,6 +513,7 @@ void UnityEngine::startupScreen() {
 		}
 		_gfx->drawSprite(p, 0, 0, 256);
 		_system->updateScreen();
+		waitForNextFrame();
 	}
 	_mixer->stopAll();
 	delete p;
@@ -665,6 +690,13 @@ void UnityEngine::DebugNextScreen() {
 	// start in first screen
 	if (curr_loc == 0x5f) { curr_loc = 2; curr_screen = 0; }
 
+	stepDebugScreen(curr_loc, curr_screen);
+	debugN("moving to %d/%d\n", curr_loc, curr_screen);
+	startAwayTeam(curr_loc, curr_screen);
+}
+
+// step through every away team screen, wrapping around to 2/1 at the end
+void UnityEngine::stepDebugScreen(unsigned int &curr_loc, unsigned int &curr_screen) {
 	curr_screen++;
 	switch (curr_loc) {
 	case 2: if (curr_screen == 2) curr_screen++;
@@ -684,8 +716,6 @@ void UnityEngine::DebugNextScreen() {
 		break;
 	default:error("huh?");
 	}
-	debugN("moving to %d/%d\n", curr_loc, curr_screen);
-	startAwayTeam(curr_loc, curr_screen);
 }
 
 void UnityEngine::checkEvents() {
@@ -866,52 +896,81 @@ void UnityEngine::drawObjects() {
 	Common::Array<Object *> &objects = data._currentScreen.objects;
 
 	Common::Array<Object *> to_draw;
+	// objects which aren't drawn but can still be clicked on (e.g. transition squares)
+	Common::Array<Object *> undrawn;
 	for (unsigned int i = 0; i < objects.size(); i++) {
-		if (objects[i]->sprite) {
-			if (!(objects[i]->flags & OBJFLAG_ACTIVE)) continue;
-			if (objects[i]->flags & OBJFLAG_INVENTORY) continue;
-
-			objects[i]->sprite->update();
+		if (!(objects[i]->flags & OBJFLAG_ACTIVE)) continue;
+		if (objects[i]->flags & OBJFLAG_INVENTORY) continue;
 
+		if (objects[i]->sprite) {
 			// TODO
-			if (!objects[i]->sprite->valid()) { debug(2, "invalid sprite?"); continue; }
-
-			to_draw.push_back(objects[i]);
+			if (objects[i]->sprite->valid()) {
+				to_draw.push_back(objects[i]);
+				continue;
+			}
+			debug(2, "invalid sprite?");
 		}
+
+		if (objects[i]->width != (unsigned int)~0)
+			undrawn.push_back(objects[i]);
 	}
 
+	Common::Array<ObjectHitEntry> drawn;
 	Common::sort(to_draw.begin(), to_draw.end(), DrawOrderComparison());
 	for (unsigned int i = 0; i < to_draw.size(); i++) {
 		// XXX: this is obviously a temporary hack
 		unsigned int scale = 256;
 		if (to_draw[i]->objwalktype == OBJWALKTYPE_SCALED) {
-			unsigned int j;
 			unsigned int x = to_draw[i]->x, y = to_draw[i]->y;
-			for (j = 0; j < data._currentScreen.polygons.size(); j++) {
-				ScreenPolygon &poly = data._currentScreen.polygons[j];
-				if (poly.type != 1) continue;
-
-				unsigned int triangle;
-				if (poly.insideTriangle(x, y, triangle)) {
-					// TODO: interpolation
-					scale = poly.triangles[triangle].distances[0];
-					break;
-				}
-			}
-			if (j == data._currentScreen.polygons.size())
+			WalkableHit hit;
+			if (data.findWalkable(x, y, hit))
+				scale = hit.distance;
+			else
 				debug(2, "couldn't find poly for walkable at (%d, %d)", x, y);
 		}
-		_gfx->drawSprite(to_draw[i]->sprite, to_draw[i]->x, to_draw[i]->y, scale);
+		SpritePlayer *sprite = to_draw[i]->sprite;
+		Common::Rect bounds = _gfx->drawSprite(sprite, to_draw[i]->x, to_draw[i]->y, scale);
+
+		if (to_draw[i]->width == (unsigned int)~0)
+			continue;
+		ObjectHitEntry entry;
+		entry.obj = to_draw[i];
+		entry.bounds = bounds;
+		entry.mask = sprite->getCurrentMask();
+		entry.maskWidth = sprite->getCurrentWidth();
+		entry.maskHeight = sprite->getCurrentHeight();
+		drawn.push_back(entry);
 	}
+
+	// merge the undrawn objects in, so the hit index is in draw order
+	Common::sort(undrawn.begin(), undrawn.end(), DrawOrderComparison());
+	_hitIndex.clear();
+	DrawOrderComparison before;
+	unsigned int d = 0;
+	for (unsigned int u = 0; u < undrawn.size(); u++) {
+		while (d < drawn.size() && !before(undrawn[u], drawn[d].obj))
+			_hitIndex.push_back(drawn[d++]);
+
+		// TODO: should we be doing this like this, or keeping track of original coords, or what?
+		Object *obj = undrawn[u];
+		ObjectHitEntry entry;
+		entry.obj = obj;
+		entry.bounds = Common::Rect(obj->x - obj->width/2, obj->y - obj->height,
+			obj->x + obj->width/2 + 1, obj->y + 1);
+		entry.mask = NULL;
+		entry.maskWidth = entry.maskHeight = 0;
+		_hitIndex.push_back(entry);
+	}
+	while (d < drawn.size())
+		_hitIndex.push_back(drawn[d++]);
 }
 
 void UnityEngine::drawDialogFrameAround(unsigned int x, unsigned int y, unsigned int width,
 	unsigned int height, bool use_thick_frame, bool with_icon, bool with_buttons) {
 	// dialog.mrg
-	MRGFile mrg;
+	MRGFile &mrg = _gfx->getMRG("dialog.mrg");
 	Common::Array<uint16> &widths = mrg.widths;
 	Common::Array<uint16> &heights = mrg.heights;
-	_gfx->loadMRG("dialog.mrg",  &mrg);
 	assert(widths.size() == 31);
 
 	unsigned int base = (use_thick_frame ? 17 : 0);
@@ -966,7 +1025,6 @@ void UnityEngine::drawDialogFrameAround(unsigned int x, unsigned int y, unsigned
 	if (with_icon && _icon) {
 		_gfx->drawMRG(&mrg, 8, real_x1 - (widths[8] / 2) + (widths[base+6]/2), (real_y1+real_y2)/2 - (heights[8]/2));
 
-		_icon->update();
 		_gfx->drawSprite(_icon, real_x1 + (widths[base+6]/2) + 1, (real_y1+real_y2)/2 + (heights[8]/2) - 4);
 	} else if (with_buttons) {
 		// TODO: 11/12/13 up buttons (normal/highlight/grayed), 14/15/16 down buttons
@@ -985,17 +1043,15 @@ void UnityEngine::initDialog() {
 	_dialogLines.clear();
 	_dialogWidth = 0;
 
-	::Graphics::Font *font = _gfx->getFont(2);
-
 	if (!_choice_list.size()) {
 		_dialogLines.resize(1);
-		_dialogWidth = font->wordWrapText(_dialog_text, maxWidth, _dialogLines[0]);
+		_dialogWidth = _gfx->wordWrapText(_dialog_text, maxWidth, _dialogLines[0], 2);
 	} else {
 		_dialogLines.resize(_choice_list.size());
 		for (uint i = 0; i < _choice_list.size(); i++) {
 			Common::String our_str = _choice_list[i];
 			Common::Array<Common::String> &lines = _dialogLines[i];
-			uint newWidth = font->wordWrapText(our_str, maxWidth, lines);
+			uint newWidth = _gfx->wordWrapText(our_str, maxWidth, lines, 2);
 			if (newWidth > _dialogWidth)
 				_dialogWidth = newWidth;
 
@@ -1028,8 +1084,7 @@ void UnityEngine::drawDialogWindow() {
 	uint y = _dialog_y;
 
 	const uint fontSpacing = 8;
-	::Graphics::Font *font = _gfx->getFont(2);
-	const uint fontHeight = font->getFontHeight();
+	const uint fontHeight = _gfx->getFontHeight(2);
 
 	uint width = _dialogWidth;
 	uint height = 0;
@@ -1050,13 +1105,12 @@ void UnityEngine::drawDialogWindow() {
 
 	_dialogRects.clear();
 
-	::Graphics::Surface *surf = _system->lockScreen();
 	if (!_choice_list.size()) {
 		for (uint i = _dialogStartLine; i < _dialogLines[0].size(); i++) {
 			if ((y - _dialog_y) + fontHeight > height)
 				break;
 
-			font->drawString(surf, _dialogLines[0][i], _dialog_x, y, width, 0);
+			_gfx->drawString(_dialog_x, y, _dialogLines[0][i], 2);
 			y += fontHeight + fontSpacing;
 		}
 	} else {
@@ -1076,13 +1130,9 @@ void UnityEngine::drawDialogWindow() {
 					break;
 				}
 
-				::Graphics::Font *thisFont = font;
 				bool selected = (j == _dialogSelected);
 				// font 2 is normal, font 3 is highlighted - but have identical metrics
-				if (selected)
-					thisFont = _gfx->getFont(3);
-
-				thisFont->drawString(surf, lines[i], _dialog_x, y, width, 0);
+				_gfx->drawString(_dialog_x, y, lines[i], selected ? 3 : 2);
 				y += fontHeight;
 				if (i != lines.size() - 1)
 					y += fontSpacing;
@@ -1090,7 +1140,6 @@ void UnityEngine::drawDialogWindow() {
 			_dialogRects.push_back(Common::Rect(_dialog_x, oldY, _dialog_x + width, y));
 		}
 	}
-	_system->unlockScreen();
 
 	// dialog window FRAME:
 	// 0 is top left, 1 is top right, 2 is bottom left, 3 is bottom right
@@ -1109,8 +1158,7 @@ void UnityEngine::drawDialogWindow() {
 
 void UnityEngine::drawAwayTeamUI() {
 	// draw UI
-	MRGFile mrg;
-	_gfx->loadMRG("awayteam.mrg", &mrg);
+	MRGFile &mrg = _gfx->getMRG("awayteam.mrg");
 	_gfx->drawMRG(&mrg, 0, 0, 400);
 
 	// notes on the UI elements not used here:
@@ -1119,7 +1167,6 @@ void UnityEngine::drawAwayTeamUI() {
 
 	// away team member icon
 	assert(_current_away_team_icon);
-	_current_away_team_icon->update();
 	_gfx->drawSprite(_current_away_team_icon, 75, 476);
 
 	// away team member health bar
@@ -1153,7 +1200,6 @@ void UnityEngine::drawAwayTeamUI() {
 		unsigned int y = 475;
 
 		SpritePlayer *icon = _inventory_icons[index];
-		icon->update();
 		_gfx->drawSprite(icon, x, y);
 	}
 
@@ -1165,6 +1211,97 @@ void UnityEngine::drawAwayTeamUI() {
 	// 3/4/5 is the low/medium/high phaser selection
 }
 
+void UnityEngine::addSpritePlayer(SpritePlayer *player) {
+	_spritePlayers.push_back(player);
+}
+
+void UnityEngine::removeSpritePlayer(SpritePlayer *player) {
+	for (uint i = 0; i < _spritePlayers.size(); i++) {
+		if (_spritePlayers[i] != player)
+			continue;
+		_spritePlayers.remove_at(i);
+		return;
+	}
+}
+
+// whether an object's sprite is animating on the current screen
+static bool isAnimating(Object *obj) {
+	if (!obj->sprite)
+		return false;
+	return (obj->flags & OBJFLAG_ACTIVE) && !(obj->flags & OBJFLAG_INVENTORY);
+}
+
+// advance the sprites of the current screen, and the interface ones, to
+// the given animation time (objects from other screens keep their sprites,
+// but stay where they were)
+void UnityEngine::updateSprites(uint32 now) {
+	for (uint i = 0; i < _spritePlayers.size(); i++)
+		_spritePlayers[i]->update(now);
+
+	Common::Array<Object *> &objects = data._currentScreen.objects;
+	for (uint i = 0; i < objects.size(); i++)
+		if (isAnimating(objects[i]))
+			objects[i]->sprite->update(now);
+}
+
+// the sprites updateSprites would advance were run on a clock other than
+// getMillis (see benchmarkScreen); move them back onto the real one
+void UnityEngine::rebaseSprites(uint32 from, uint32 to) {
+	for (uint i = 0; i < _spritePlayers.size(); i++)
+		_spritePlayers[i]->rebaseTime(from, to);
+
+	Common::Array<Object *> &objects = data._currentScreen.objects;
+	for (uint i = 0; i < objects.size(); i++)
+		if (isAnimating(objects[i]))
+			objects[i]->sprite->rebaseTime(from, to);
+}
+
+uint32 UnityEngine::getNextSpriteChange() const {
+	uint32 next = 0xffffffff;
+	for (uint i = 0; i < _spritePlayers.size(); i++)
+		next = MIN(next, _spritePlayers[i]->getNextUpdate());
+
+	const Common::Array<Object *> &objects = data._currentScreen.objects;
+	for (uint i = 0; i < objects.size(); i++)
+		if (isAnimating(objects[i]))
+			next = MIN(next, objects[i]->sprite->getNextUpdate());
+	return next;
+}
+
+// sleep until a sprite is due to change, but not so long that input feels slow
+void UnityEngine::waitForNextFrame() {
+	const uint32 maxDelay = 16;
+
+	uint32 now = _system->getMillis();
+	uint32 next = getNextSpriteChange();
+	if (next > now)
+		_system->delayMillis(MIN(next - now, maxDelay));
+}
+
+// record everything this frame shows
+void UnityEngine::recordFrame(bool withDialog) {
+	_gfx->beginFrame();
+	_gfx->drawBackgroundImage();
+	_gfx->drawPolygonOverlay();
+
+	drawObjects();
+	if (_on_away_team) {
+		drawAwayTeamUI();
+	} else {
+		_currScreen->draw();
+	}
+
+	if (withDialog)
+		drawDialogWindow();
+	_gfx->endFrame();
+}
+
+void UnityEngine::drawFrame(bool withDialog) {
+	updateSprites(_system->getMillis());
+	recordFrame(withDialog);
+	_gfx->renderFrame();
+}
+
 Common::Error UnityEngine::run() {
 	init();
 
@@ -1180,6 +1317,26 @@ Common::Error UnityEngine::run() {
 	data.loadMovieInfo();
 	data.loadComputerDatabase();
 
+	// the bridge and computer clicks, so the first ones don't wait on the disk
+	_snd->preloadSfx("beep7.mac");
+	_snd->preloadSfx("tactical.mac");
+	_snd->preloadSfx("level2.mac");
+
+	if (ConfMan.hasKey("benchmark_decoders")) {
+		Common::String type = ConfMan.get("benchmark_decoders");
+		runDecoderBenchmark(type == "all" ? Common::String() : type);
+		return Common::kNoError;
+	}
+
+	if (ConfMan.hasKey("benchmark") && ConfMan.getBool("benchmark")) {
+		unsigned int frames = 100;
+		if (ConfMan.hasKey("benchmark_frames"))
+			frames = ConfMan.getInt("benchmark_frames");
+		bool present = ConfMan.hasKey("benchmark_present") && ConfMan.getBool("benchmark_present");
+		runBenchmark(frames, present);
+		return Common::kNoError;
+	}
+
 	startupScreen();
 
 	// TODO: are the indexes identical in all versions?
@@ -1194,16 +1351,14 @@ Common::Error UnityEngine::run() {
 	while (!shouldQuit()) {
 		checkEvents();
 
-		_gfx->drawBackgroundImage();
-		_gfx->drawBackgroundPolys(data._currentScreen.polygons);
-
-		drawObjects();
-		if (_on_away_team) {
-			drawAwayTeamUI();
-		} else {
-			_currScreen->draw();
+		if (_benchmarkFrames) {
+			runBenchmark(_benchmarkFrames, _benchmarkPresent);
+			_benchmarkFrames = 0;
+			continue;
 		}
 
+		drawFrame(false);
+
 		assert(!_in_dialog);
 
 		while (_next_situation != 0xffffffff && !shouldQuit()) {
@@ -1221,6 +1376,7 @@ Common::Error UnityEngine::run() {
 		processTimers();
 
 		_system->updateScreen();
+		waitForNextFrame();
 	}
 
 	return Common::kNoError;
@@ -1259,22 +1415,13 @@ void UnityEngine::runDialog() {
 	while (_in_dialog) {
 		checkEvents();
 
-		_gfx->drawBackgroundImage();
-		_gfx->drawBackgroundPolys(data._currentScreen.polygons);
-
-		drawObjects();
-		if (_on_away_team) {
-			drawAwayTeamUI();
-		} else {
-			_currScreen->draw();
-		}
-
-		drawDialogWindow();
+		drawFrame(true);
 		if (_icon && _icon->playing() && !_snd->speechPlaying()) {
 			_icon->startAnim(0); // static
 		}
 
 		_system->updateScreen();
+		waitForNextFrame();
 	}
 
 	// TODO: reset cursor
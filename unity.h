@@ -19,11 +19,16 @@
 
 #include "engines/engine.h"
 #include "common/random.h"
+#include "common/str.h"
 
 #include "unity/console.h"
 
 #include "data.h"
 
+namespace Graphics {
+	struct Surface;
+}
+
 namespace Unity {
 
 class Graphics;
@@ -62,6 +67,21 @@ enum ScreenType {
 	ViewscreenScreenType
 };
 
+// time (in ms) spent in each stage of loading a location, for the benchmark
+struct LoadTimings {
+	uint32 background, polygons, objects, sprites;
+};
+
+// where an object was drawn last frame, for hit testing
+struct ObjectHitEntry {
+	Object *obj;
+	Common::Rect bounds;
+	const byte *mask; // NULL to use the whole rectangle
+	unsigned int maskWidth, maskHeight;
+
+	bool contains(unsigned int x, unsigned int y) const;
+};
+
 class UnityEngine : public Engine {
 public:
 	UnityEngine(class OSystem *syst);
@@ -128,6 +148,12 @@ public:
 
 	void changeToScreen(ScreenType screenType);
 
+	void addSpritePlayer(SpritePlayer *player);
+	void removeSpritePlayer(SpritePlayer *player);
+
+	bool requestBenchmark(unsigned int frames, bool present);
+	void runDecoderBenchmark(const Common::String &type);
+
 protected:
 	UnityConsole *_console;
 
@@ -146,7 +172,20 @@ protected:
 	void handleAwayTeamMouseMove(const Common::Point &pos);
 	void handleAwayTeamMouseClick(const Common::Point &pos);
 
+	// the sprite players which aren't an object's (icons and the like);
+	// updateSprites advances these and those of the current screen's objects
+	Common::Array<SpritePlayer *> _spritePlayers;
+	void updateSprites(uint32 now);
+	void rebaseSprites(uint32 from, uint32 to);
+	uint32 getNextSpriteChange() const;
+	void waitForNextFrame();
+
+	// objects in draw order, as drawn by the last drawObjects call
+	Common::Array<ObjectHitEntry> _hitIndex;
+
 	void drawObjects();
+	void recordFrame(bool withDialog);
+	void drawFrame(bool withDialog);
 	void processTriggers();
 	void processTimers();
 
@@ -172,6 +211,16 @@ protected:
 	void handleTalk(Object *obj);
 
 	void DebugNextScreen();
+	static void stepDebugScreen(unsigned int &world, unsigned int &screen);
+
+	// benchmark mode (see debug.cpp)
+	bool _benchmarking;
+	unsigned int _benchmarkFrames; // non-zero if one was requested
+	bool _benchmarkPresent;
+	LoadTimings _loadTimings;
+	void runBenchmark(unsigned int frames, bool present);
+	Common::String benchmarkScreen(const Common::String &name, uint32 loadTime,
+		unsigned int frames, bool present, ::Graphics::Surface *surface);
 };
 
 } // Unity
@@ -27,7 +27,7 @@ ViewscreenScreen::~ViewscreenScreen() {
 
 void ViewscreenScreen::start() {
 	_vm->clearObjects();
-	_vm->data._currentScreen.polygons.clear();
+	_vm->data.clearScreenPolys();
 	_vm->data._currentScreen.world = 0x5f;
 	_vm->data._currentScreen.screen = 0xff;
 